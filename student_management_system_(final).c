@@ -4,24 +4,120 @@
     Features:
     - Persistent storage in CSV: students.csv (auto-load on start, auto-save on changes)
     - Create / Read / Update / Delete (CRUD)
-    - Search by Roll No. or Name (case-insensitive substring)
+    - Search by Roll No. or Name (case-insensitive substring, Unicode simple case folding)
+    - Bloom filters reject lookups of missing rolls and exact names up front
+    - Duplicate detection on add / CSV import, and a whole-roster dedup report
+    - Roll ranges in roll order from a sorted, Eytzinger-ordered roll index
+    - Smart search: exact -> prefix -> substring -> fuzzy tiers, top-N ranked
     - Sorting: by Roll, Name, or Average (Asc/Desc)
     - Statistics: class average, topper, lowest, grade distribution
     - Export: nicely formatted report.txt
+    - Term history: append-only, delta-encoded marks per term (FILE.history)
+      with per-term summaries for trend and class-average queries
+    - Join: stream an external CSV (attendance, fees) against the roster on roll
+    - Batch mode, workload recording (--record) and timed replay with latency percentiles
+    - Lazy loading (--lazy-names): names stay in the file buffer until first needed
+    - Large rosters live in huge-page backed memory (--hugepages), with a lookup benchmark
+    - USDT probes for perf / bpftrace when <sys/sdt.h> is available
+    - Prometheus textfile metrics (--metrics FILE)
+    - Chrome / Perfetto trace-event timelines (--trace FILE)
+    - Write-ahead log (--wal) with checkpoints and parallel crash recovery
+    - Roll and name indexes persisted to FILE.idx and memory-mapped at startup
+    - Progressive startup: roll and name lookups run while a large roster is still parsing
+    - Concurrent roll map (lock-free reads, striped writers, epoch reclamation) with a benchmark
+    - Per-record seqlock versions: lock-free snapshot reads, optimistic compare-and-swap edits
+    - Transactions (begin / commit / abort) logged as one batch, with group commit
+    - Zone maps (per-block min/max of roll, average, subjects) let filtered scans skip blocks
+    - Arrow C Data Interface export of the roster columns, and Arrow IPC files (arrow FILE)
     - Clean, menu-driven UI with validation
 
     Notes:
-    - Name cannot contain commas (,) since we use CSV commas. Commas are auto-converted to spaces.
+    - Names may contain commas and quotes; they are quoted in the CSV per RFC 4180.
     - Marks allowed: 0..100
     - MAX_SUBJECTS per student can be adjusted.
 */
 
+// st_mtim, truncate(), syscall() and MAP_ANONYMOUS are hidden under a strict -std=c11
+#if !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <strings.h>
+#include <time.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#endif
+
+/*
+   Static tracepoints (USDT, provider "sms"). With <sys/sdt.h> each probe
+   is a nop plus an ELF note that perf and bpftrace can attach to, e.g.
+     bpftrace -e 'usdt:./sms:sms:save__done { @us = hist(arg2 / 1000); }'
+   Without the header they compile away, arguments unevaluated.
+   Arguments are integers or C strings; durations are nanoseconds. Each
+   probe has a semaphore that perf / bpftrace raise while attached, so
+   durations are only measured when a probe, --metrics or --trace wants
+   them (see spanStart()).
+*/
+#if defined(__has_include) && !defined(_WIN32)
+#if __has_include(<sys/sdt.h>)
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define HAVE_SDT 1
+#endif
+#endif
+
+#ifdef HAVE_SDT
+#define PROBE_SEMAPHORE(name) \
+    __extension__ unsigned short sms_##name##_semaphore __attribute__((unused, section(".probes")))
+PROBE_SEMAPHORE(search);
+PROBE_SEMAPHORE(index__build);
+PROBE_SEMAPHORE(mutation);
+PROBE_SEMAPHORE(save__start);
+PROBE_SEMAPHORE(save__done);
+PROBE_SEMAPHORE(load__start);
+PROBE_SEMAPHORE(load__done);
+PROBE_SEMAPHORE(sort);
+PROBE_SEMAPHORE(stats);
+PROBE_SEMAPHORE(command__start);
+PROBE_SEMAPHORE(command__done);
+#define PROBE1(name, a)          DTRACE_PROBE1(sms, name, a)
+#define PROBE2(name, a, b)       DTRACE_PROBE2(sms, name, a, b)
+#define PROBE3(name, a, b, c)    DTRACE_PROBE3(sms, name, a, b, c)
+#define PROBE4(name, a, b, c, d) DTRACE_PROBE4(sms, name, a, b, c, d)
+// Nonzero while a probe that reports a duration is attached.
+#define PROBES_TIMED() (sms_search_semaphore | sms_index__build_semaphore | sms_save__done_semaphore | \
+                        sms_load__done_semaphore | sms_sort_semaphore | sms_stats_semaphore | \
+                        sms_command__done_semaphore)
+#else                                   // sizeof: referenced, never evaluated
+#define PROBE1(name, a)          ((void)sizeof(a))
+#define PROBE2(name, a, b)       ((void)sizeof(a), (void)sizeof(b))
+#define PROBE3(name, a, b, c)    ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c))
+#define PROBE4(name, a, b, c, d) ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c), (void)sizeof(d))
+#define PROBES_TIMED() 0
+#endif
 
-#define MAX_STUDENTS 1000
+#define MAX_STUDENTS 10000000
 #define MAX_NAME 100
 #define MAX_SUBJECTS 10
 #define DATA_FILE "students.csv"
@@ -30,14 +126,28 @@
 typedef struct {
     int   roll;
     char  name[MAX_NAME];
+    char  folded[MAX_NAME]; // case-folded name for search and sort
     int   subjectCount;
     int   marks[MAX_SUBJECTS];
     float average;
     char  grade;
+    int   lazyName;     // --lazy-names: 1 + offset of the unparsed name in loadBuf, 0 once name[] is filled
+    _Atomic unsigned version;   // seqlock, kept last: odd while commitStudent() is replacing the fields above
 } Student;
 
-static Student students[MAX_STUDENTS];
+static Student *students = NULL;   // bigAlloc'd, grown by reserveStudents()
 static int studentCount = 0;
+static int studentCapacity = 0;
+static const char *dataFile = DATA_FILE;
+
+static int lazyNames = 0;          // defer copying names out of the loaded file
+static char *loadBuf = NULL;       // raw file contents backing unparsed names
+static int namesPending = 0;       // students whose name[] is still unfilled
+static int nameIndexStale = 1;     // names changed since the name index was built
+static int sortedRollStale = 1;    // rolls changed since the sorted roll index was built
+static int dupIndexStale = 1;      // records moved or renamed since the duplicate index was built
+static int zoneMapStale = 1;       // records moved since the zone maps were built
+static int rosterDirty = 0;        // rolls, names or order changed since the last load or save
 
 /* -------------------- Utilities -------------------- */
 
@@ -63,13 +173,6 @@ void safeGets(char *buf, int size) {
     }
 }
 
-void sanitizeName(char *name) {
-    // Replace commas with spaces to keep CSV simple
-    for (char *p = name; *p; ++p) {
-        if (*p == ',') *p = ' ';
-    }
-}
-
 int inputIntInRange(const char *prompt, int min, int max) {
     int x;
     while (1) {
@@ -85,19 +188,6 @@ int inputIntInRange(const char *prompt, int min, int max) {
     }
 }
 
-int containsIgnoreCase(const char *haystack, const char *needle) {
-    if (!*needle) return 1;
-    size_t nlen = strlen(needle);
-    for (const char *p = haystack; *p; ++p) {
-        size_t i = 0;
-        while (i < nlen && p[i] && tolower((unsigned char)p[i]) == tolower((unsigned char)needle[i])) {
-            i++;
-        }
-        if (i == nlen) return 1;
-    }
-    return 0;
-}
-
 char calculateGrade(float avg) {
     if (avg >= 90.0f) return 'A';
     else if (avg >= 75.0f) return 'B';
@@ -113,6 +203,28 @@ void recompute(Student *s) {
     s->grade = calculateGrade(s->average);
 }
 
+static double nowSeconds() {
+#ifdef _WIN32
+    return (double)clock() / CLOCKS_PER_SEC;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+static int timingOn = 0;               // --metrics or --trace: durations are consumed
+
+// Start of an instrumented span: 0 (and no clock read) when no metric, trace or probe wants durations.
+static double spanStart() {
+    return timingOn || PROBES_TIMED() ? nowSeconds() : 0;
+}
+
+// Nanoseconds since a spanStart() value; 0 if the span was not timed.
+long long nsSince(double t0) {
+    return t0 ? (long long)((nowSeconds() - t0) * 1e9) : 0;
+}
+
 int findMaxRoll() {
     int maxr = 0;
     for (int i = 0; i < studentCount; ++i)
@@ -120,381 +232,6950 @@ int findMaxRoll() {
     return maxr;
 }
 
-int findIndexByRoll(int roll) {
-    for (int i = 0; i < studentCount; ++i)
-        if (students[i].roll == roll) return i;
-    return -1;
-}
-
-/* -------------- Persistence (CSV) ------------------ */
+/* --------------------- Arenas ---------------------- */
 /*
-   CSV format (one line per student):
-   roll,name,subjectCount,marks_semicolon_separated,average,grade
+   Scratch memory for a single command. Allocation bumps a pointer in
+   the current block; runCommand() resets every arena when the command
+   finishes. Blocks are kept across resets, so once the arenas have
+   grown to a workload's peak, commands run without malloc/free.
 
-   Example:
-   1, Alice Johnson, 3, 85;90;78, 84.33, B
+   queryArena serves the thread running the command; parallel workers
+   use threadArena(), one arena per worker slot, so they never contend.
+   inputArena holds the lines of a batch or replay file, which must
+   outlive the commands they carry; it is never reset by a command.
 */
 
-void saveAll() {
-    FILE *fp = fopen(DATA_FILE, "w");
-    if (!fp) {
-        printf("Error: cannot write to %s\n", DATA_FILE);
-        return;
-    }
-    fprintf(fp, "roll,name,subjectCount,marks,average,grade\n");
-    for (int i = 0; i < studentCount; ++i) {
-        Student *s = &students[i];
-        fprintf(fp, "%d,%s,%d,", s->roll, s->name, s->subjectCount);
-        // marks list
-        for (int j = 0; j < s->subjectCount; ++j) {
-            fprintf(fp, "%d", s->marks[j]);
-            if (j != s->subjectCount - 1) fprintf(fp, ";");
-        }
-        fprintf(fp, ",%.2f,%c\n", s->average, s->grade);
-    }
-    fclose(fp);
-}
-
-void loadAll() {
-    FILE *fp = fopen(DATA_FILE, "r");
-    if (!fp) {
-        // no existing file — start fresh
-        studentCount = 0;
-        return;
-    }
-    char line[1024];
-    // skip header if present
-    if (fgets(line, sizeof(line), fp)) {
-        if (strncmp(line, "roll,", 5) != 0) {
-            // header missing; line might be data—rewind to parse it
-            fseek(fp, 0, SEEK_SET);
-        }
-    } else {
-        fclose(fp);
-        return;
-    }
+#define ARENA_MIN_BLOCK (64 * 1024)
+#define MAX_WORKERS 128
+#define BACKGROUND_SLOT (MAX_WORKERS / 2)   // loader and index-builder threads; their parallelFor workers sit above
 
-    studentCount = 0;
-    while (fgets(line, sizeof(line), fp) && studentCount < MAX_STUDENTS) {
-        // parse CSV fields
-        // tokenize by comma: roll, name, subjectCount, marks_list, average, grade
-        char *p = line;
-        // strip newline
-        size_t ln = strlen(p);
-        if (ln && (p[ln-1] == '\n' || p[ln-1] == '\r')) p[--ln] = '\0';
-
-        char *tok;
-        // roll
-        tok = strtok(p, ",");
-        if (!tok) continue;
-        Student s = {0};
-        s.roll = atoi(tok);
-
-        // name
-        tok = strtok(NULL, ",");
-        if (!tok) continue;
-        strncpy(s.name, tok, MAX_NAME - 1);
-        s.name[MAX_NAME - 1] = '\0';
-
-        // subjectCount
-        tok = strtok(NULL, ",");
-        if (!tok) continue;
-        s.subjectCount = atoi(tok);
-        if (s.subjectCount < 1 || s.subjectCount > MAX_SUBJECTS) continue;
-
-        // marks list (semicolon separated)
-        tok = strtok(NULL, ",");
-        if (!tok) continue;
-        {
-            char tmp[512];
-            strncpy(tmp, tok, sizeof(tmp) - 1);
-            tmp[sizeof(tmp) - 1] = '\0';
-            int idx = 0;
-            char *mtok = strtok(tmp, ";");
-            while (mtok && idx < s.subjectCount) {
-                s.marks[idx++] = atoi(mtok);
-                mtok = strtok(NULL, ";");
-            }
-            if (idx != s.subjectCount) continue; // malformed line
-        }
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size, used;
+    max_align_t data[];
+} ArenaBlock;
 
-        // average
-        tok = strtok(NULL, ",");
-        if (!tok) continue;
-        s.average = (float)atof(tok);
+typedef struct {
+    ArenaBlock *first, *current;
+} Arena;
 
-        // grade
-        tok = strtok(NULL, ",");
-        if (!tok) continue;
-        s.grade = tok[0];
+static Arena queryArena, inputArena;
+static Arena workerArenas[MAX_WORKERS];
+static atomic_long arenaBlockAllocs;       // blocks ever malloc'd, to watch steady state
+static _Thread_local int workerSlot = 0;   // 0: the command's own thread
 
-        students[studentCount++] = s;
+void *arenaAlloc(Arena *a, size_t size) {
+    size = (size + sizeof(max_align_t) - 1) / sizeof(max_align_t) * sizeof(max_align_t);
+    if (!size) size = sizeof(max_align_t);
+    for (ArenaBlock *b = a->current; b; b = b->next) {
+        if (b->size - b->used >= size) {
+            void *p = (char *)b->data + b->used;
+            b->used += size;
+            a->current = b;
+            return p;
+        }
     }
-    fclose(fp);
+    size_t blockSize = size > ARENA_MIN_BLOCK ? size : ARENA_MIN_BLOCK;
+    if (a->current && a->current->size * 2 > blockSize) blockSize = a->current->size * 2;
+    ArenaBlock *b = malloc(sizeof(ArenaBlock) + blockSize);
+    if (!b) return NULL;
+    atomic_fetch_add(&arenaBlockAllocs, 1);
+    b->size = blockSize;
+    b->used = size;
+    b->next = NULL;
+    // append after the last block so existing blocks stay in reuse order
+    ArenaBlock **tail = &a->first;
+    while (*tail) tail = &(*tail)->next;
+    *tail = b;
+    a->current = b;
+    return b->data;
 }
 
-/* -------------------- UI Helpers ------------------- */
+// Returns a buffer of at least need bytes: buf itself if *cap suffices,
+// else a larger one from a holding the first keep bytes of buf.
+void *arenaGrow(Arena *a, void *buf, size_t keep, size_t *cap, size_t need) {
+    if (buf && need <= *cap) return buf;
+    size_t ncap = *cap * 2 > need ? *cap * 2 : need;
+    void *p = arenaAlloc(a, ncap);
+    if (!p) return NULL;
+    if (keep) memcpy(p, buf, keep);
+    *cap = ncap;
+    return p;
+}
 
-void printBanner() {
-    printf("==============================================\n");
-    printf("     Student Management System – v1.0 (C)     \n");
-    printf("==============================================\n");
+void arenaReset(Arena *a) {
+    for (ArenaBlock *b = a->first; b; b = b->next) b->used = 0;
+    a->current = a->first;
 }
 
-void printTableHeader() {
-    printf("\n%-6s  %-25s  %-8s  %-8s  %-5s\n", "Roll", "Name", "Subjects", "Average", "Grade");
-    printf("------  -------------------------  --------  --------  -----\n");
+Arena *threadArena() {
+    return workerSlot == 0 ? &queryArena : &workerArenas[workerSlot];
 }
 
-void printStudentRow(const Student *s) {
-    printf("%-6d  %-25.25s  %-8d  %-8.2f  %-5c\n",
-           s->roll, s->name, s->subjectCount, s->average, s->grade);
+void resetScratch() {
+    arenaReset(&queryArena);
+    for (int i = 1; i < MAX_WORKERS; ++i)
+        if (workerArenas[i].first) arenaReset(&workerArenas[i]);
 }
 
-/* -------------------- Core Actions ----------------- */
+/* ---------------- Large Allocations ---------------- */
+/*
+   The record store and the hash indexes can reach gigabytes, where
+   random roll lookups miss the TLB on almost every probe. bigAlloc()
+   serves such allocations from huge pages when allowed:
 
-void addStudent() {
-    if (studentCount >= MAX_STUDENTS) {
-        printf("Cannot add more students (limit reached).\n");
-        return;
-    }
+     hugetlb  explicit MAP_HUGETLB pages (needs a reserved pool)
+     madvise  2 MB-aligned anonymous mapping + MADV_HUGEPAGE (THP)
+     auto     hugetlb, falling back to madvise (default)
+     off      plain malloc
 
-    Student s = {0};
-    s.roll = findMaxRoll() + 1;
+   Small requests and platforms without mmap always use malloc. Each
+   block starts with a header recording how to release it. Advised bytes
+   are only eligible for THP; anonHugeBytes() says how much the kernel
+   actually backed with huge pages.
+*/
 
-    printf("Enter student name: ");
-    char buf[256];
-    safeGets(buf, sizeof(buf));
-    if (strlen(buf) == 0) {
-        printf("Name cannot be empty.\n");
-        return;
-    }
-    sanitizeName(buf);
-    strncpy(s.name, buf, MAX_NAME - 1);
+#define HUGE_PAGE_SIZE (2u * 1024 * 1024)
 
-    s.subjectCount = inputIntInRange("Enter number of subjects (1-10): ", 1, MAX_SUBJECTS);
+enum { HP_OFF, HP_MADVISE, HP_HUGETLB, HP_AUTO };
+enum { BIG_MALLOC, BIG_MMAP };
 
-    for (int i = 0; i < s.subjectCount; ++i) {
-        char prompt[64];
-        snprintf(prompt, sizeof(prompt), "Enter marks for subject %d (0-100): ", i + 1);
-        s.marks[i] = inputIntInRange(prompt, 0, 100);
-    }
-    recompute(&s);
-    students[studentCount++] = s;
-    saveAll();
+typedef struct {
+    void  *base;          // start of the mapping / malloc block
+    size_t mapped;        // bytes to munmap (BIG_MMAP) or malloc'd
+    int    kind;
+    int    huge;          // 1: hugetlb, 2: THP advised, 0: normal pages
+} BigHeader;
 
-    printf("\n✅ Added: Roll %d | %s | Avg: %.2f | Grade: %c\n", s.roll, s.name, s.average, s.grade);
-}
+#define BIG_HEADER_SIZE 64                 // keeps the payload cache-line aligned
 
-void listAll() {
-    if (studentCount == 0) {
-        printf("No records to display.\n");
-        return;
-    }
-    printTableHeader();
-    for (int i = 0; i < studentCount; ++i) printStudentRow(&students[i]);
+static int hugePageMode = HP_AUTO;
+static atomic_long bigBytesHugetlb, bigBytesAdvised, bigBytesNormal;
+
+static atomic_long *bigBytes(int huge) {
+    return huge == 1 ? &bigBytesHugetlb : huge == 2 ? &bigBytesAdvised : &bigBytesNormal;
 }
 
-void searchByRoll() {
-    if (studentCount == 0) { printf("No records.\n"); return; }
-    int roll = inputIntInRange("Enter roll number: ", 1, 1000000000);
-    int idx = findIndexByRoll(roll);
-    if (idx < 0) { printf("No student with roll %d.\n", roll); return; }
-    printTableHeader();
-    printStudentRow(&students[idx]);
-    // show marks detail
-    printf("Marks: ");
-    for (int i = 0; i < students[idx].subjectCount; ++i) {
-        printf("%d", students[idx].marks[i]);
-        if (i != students[idx].subjectCount - 1) printf(", ");
-    }
-    printf("\n");
+// This process's anonymous memory backed by transparent huge pages, in bytes; -1 if unknown.
+long anonHugeBytes() {
+#ifdef __linux__
+    FILE *fp = fopen("/proc/self/smaps_rollup", "r");
+    if (!fp) return -1;
+    char line[256];
+    long kb = -1;
+    while (kb < 0 && fgets(line, sizeof(line), fp))
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) != 1) kb = -1;
+    fclose(fp);
+    return kb < 0 ? -1 : kb * 1024;
+#else
+    return -1;
+#endif
 }
 
-void searchByName() {
-    if (studentCount == 0) { printf("No records.\n"); return; }
-    char q[128];
-    printf("Enter name (or part of it): ");
-    safeGets(q, sizeof(q));
-    if (strlen(q) == 0) { printf("Query empty.\n"); return; }
+int parseHugePageMode(const char *text) {
+    if (strcmp(text, "off") == 0)     return HP_OFF;
+    if (strcmp(text, "madvise") == 0) return HP_MADVISE;
+    if (strcmp(text, "hugetlb") == 0) return HP_HUGETLB;
+    if (strcmp(text, "auto") == 0)    return HP_AUTO;
+    return -1;
+}
 
-    int hits = 0;
-    printTableHeader();
-    for (int i = 0; i < studentCount; ++i) {
-        if (containsIgnoreCase(students[i].name, q)) {
-            printStudentRow(&students[i]);
-            hits++;
+void *bigAlloc(size_t size) {
+    size_t total = size + BIG_HEADER_SIZE;
+    BigHeader h = { NULL, 0, BIG_MALLOC, 0 };
+    char *payload = NULL;
+#if !defined(_WIN32)
+    if (hugePageMode != HP_OFF && total >= HUGE_PAGE_SIZE) {
+        size_t rounded = (total + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+#ifdef MAP_HUGETLB
+        if (hugePageMode == HP_HUGETLB || hugePageMode == HP_AUTO) {
+            void *p = mmap(NULL, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED) { h.base = p; h.mapped = rounded; h.kind = BIG_MMAP; h.huge = 1; }
+        }
+#endif
+#ifdef MADV_HUGEPAGE
+        if (!h.base && (hugePageMode == HP_MADVISE || hugePageMode == HP_AUTO)) {
+            // over-map by one huge page, then trim so the block is 2 MB aligned
+            size_t span = rounded + HUGE_PAGE_SIZE;
+            char *p = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p != MAP_FAILED) {
+                char *aligned = (char *)(((uintptr_t)p + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+                if (aligned > p) munmap(p, (size_t)(aligned - p));
+                if (p + span > aligned + rounded) munmap(aligned + rounded, (size_t)(p + span - aligned - rounded));
+                madvise(aligned, rounded, MADV_HUGEPAGE);
+                h.base = aligned; h.mapped = rounded; h.kind = BIG_MMAP; h.huge = 2;
+            }
         }
+#endif
     }
-    if (!hits) printf("No matches for \"%s\".\n", q);
+#endif
+    if (!h.base) {
+        h.base = malloc(total);
+        if (!h.base) return NULL;
+        h.mapped = total;
+    }
+    payload = (char *)h.base + BIG_HEADER_SIZE;
+    memcpy(payload - sizeof(BigHeader), &h, sizeof(BigHeader));
+    atomic_fetch_add(bigBytes(h.huge), (long)h.mapped);
+    return payload;
 }
 
-void updateStudent() {
-    if (studentCount == 0) { printf("No records.\n"); return; }
-    int roll = inputIntInRange("Enter roll number to update: ", 1, 1000000000);
-    int idx = findIndexByRoll(roll);
-    if (idx < 0) { printf("No student with roll %d.\n", roll); return; }
-
-    Student *s = &students[idx];
-    printf("\nEditing Roll %d (%s)\n", s->roll, s->name);
-    printf("1) Update Name\n");
-    printf("2) Update Subjects & Marks\n");
-    printf("3) Cancel\n");
-    int ch = inputIntInRange("Choose: ", 1, 3);
-
-    if (ch == 1) {
-        printf("New name: ");
-        char buf[256];
-        safeGets(buf, sizeof(buf));
-        if (strlen(buf) == 0) { printf("Name unchanged.\n"); return; }
-        sanitizeName(buf);
-        strncpy(s->name, buf, MAX_NAME - 1);
-    } else if (ch == 2) {
-        s->subjectCount = inputIntInRange("Enter number of subjects (1-10): ", 1, MAX_SUBJECTS);
-        for (int i = 0; i < s->subjectCount; ++i) {
-            char prompt[64];
-            snprintf(prompt, sizeof(prompt), "Enter marks for subject %d (0-100): ", i + 1);
-            s->marks[i] = inputIntInRange(prompt, 0, 100);
-        }
-        recompute(s);
-    } else {
-        printf("Cancelled.\n");
+void bigFree(void *ptr) {
+    if (!ptr) return;
+    BigHeader h;
+    memcpy(&h, (char *)ptr - sizeof(BigHeader), sizeof(BigHeader));
+    atomic_fetch_sub(bigBytes(h.huge), (long)h.mapped);
+#if !defined(_WIN32)
+    if (h.kind == BIG_MMAP) {
+        munmap(h.base, h.mapped);
         return;
     }
+#endif
+    free(h.base);
+}
 
-    recompute(s);
-    saveAll();
-    printf("✅ Updated successfully.\n");
+void waitIndexBuild();
+
+// Make room for at least `need` records; grows geometrically.
+int reserveStudents(int need) {
+    if (need <= studentCapacity) return 1;
+    if (need > MAX_STUDENTS) return 0;
+    waitIndexBuild();                   // a background build may still be reading the old array
+    int cap = studentCapacity ? studentCapacity : 64;
+    while (cap < need) cap = cap > MAX_STUDENTS / 2 ? MAX_STUDENTS : cap * 2;
+    Student *grown = bigAlloc(sizeof(Student) * (size_t)cap);
+    if (!grown) return 0;
+    if (studentCount) memcpy(grown, students, sizeof(Student) * (size_t)studentCount);
+    bigFree(students);
+    students = grown;
+    studentCapacity = cap;
+    return 1;
 }
 
-void deleteStudent() {
-    if (studentCount == 0) { printf("No records.\n"); return; }
-    int roll = inputIntInRange("Enter roll number to delete: ", 1, 1000000000);
-    int idx = findIndexByRoll(roll);
-    if (idx < 0) { printf("No student with roll %d.\n", roll); return; }
+/* --------------------- Tracing --------------------- */
+/*
+   --trace FILE records nested spans (commands, load/save phases, index
+   builds, searches, worker ranges) and writes them as Chrome trace-event
+   JSON at exit; open it in chrome://tracing or ui.perfetto.dev. Each
+   worker slot owns a ring buffer, so recording takes no locks; when a
+   ring fills, the oldest spans are overwritten and counted as dropped.
+   Span names must be string literals or otherwise outlive the process.
+*/
 
-    printf("Are you sure you want to delete Roll %d (%s)? (y/n): ", students[idx].roll, students[idx].name);
-    int c = getchar(); int ch; while ((ch = getchar()) != '\n' && ch != EOF) {}
-    if (c != 'y' && c != 'Y') { printf("Cancelled.\n"); return; }
+#define TRACE_RING_SIZE (1 << 16)
 
-    for (int i = idx; i < studentCount - 1; ++i) students[i] = students[i + 1];
-    studentCount--;
-    saveAll();
-    printf("✅ Deleted.\n");
-}
+typedef struct {
+    const char *name, *cat, *argName;
+    double start, dur;              // seconds since traceStart
+    long long arg;
+} TraceEvent;
 
-/* -------------------- Sorting ---------------------- */
+typedef struct {
+    long long written;              // total events ever recorded
+    TraceEvent ev[TRACE_RING_SIZE];
+} TraceRing;
 
-int cmpRollAsc(const void *a, const void *b) {
-    const Student *x = (const Student *)a, *y = (const Student *)b;
-    return (x->roll - y->roll);
+static const char *tracePath = NULL;
+static double traceStart = 0.0;
+static TraceRing *traceRings[MAX_WORKERS];
+
+// Records a span that began at t0 (a spanStart() value) and ends now.
+void traceSpan(const char *name, const char *cat, double t0, const char *argName, long long arg) {
+    if (!tracePath) return;
+    double now = nowSeconds();
+    TraceRing *r = traceRings[workerSlot];
+    if (!r) {
+        r = traceRings[workerSlot] = calloc(1, sizeof(TraceRing));   // slot is owned by this thread
+        if (!r) return;
+    }
+    TraceEvent *e = &r->ev[r->written++ & (TRACE_RING_SIZE - 1)];
+    e->name = name;
+    e->cat = cat;
+    e->argName = argName;
+    e->start = t0 - traceStart;
+    e->dur = now - t0;
+    e->arg = arg;
 }
-int cmpRollDesc(const void *a, const void *b) { return -cmpRollAsc(a,b); }
 
-int cmpNameAsc(const void *a, const void *b) {
-    const Student *x = (const Student *)a, *y = (const Student *)b;
-    return strcasecmp(x->name, y->name);
+static void writeTrace() {
+    FILE *fp = fopen(tracePath, "w");
+    if (!fp) { fprintf(stderr, "Error: cannot write trace to %s\n", tracePath); return; }
+    long long events = 0, dropped = 0;
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(fp, "{\"ph\":\"M\",\"pid\":1,\"tid\":0,\"name\":\"process_name\",\"args\":{\"name\":\"student_management_system\"}}");
+    for (int slot = 0; slot < MAX_WORKERS; ++slot) {
+        TraceRing *r = traceRings[slot];
+        if (!r) continue;
+        fprintf(fp, ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"%s %d\"}}",
+                slot, slot == BACKGROUND_SLOT ? "background" : slot > BACKGROUND_SLOT ? "background worker" : slot ? "worker" : "main", slot);
+        long long first = r->written > TRACE_RING_SIZE ? r->written - TRACE_RING_SIZE : 0;
+        dropped += first;
+        for (long long k = first; k < r->written; ++k) {
+            const TraceEvent *e = &r->ev[k & (TRACE_RING_SIZE - 1)];
+            fprintf(fp, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"name\":\"%s\",\"cat\":\"%s\",\"ts\":%.3f,\"dur\":%.3f",
+                    slot, e->name, e->cat, e->start * 1e6, e->dur * 1e6);
+            if (e->argName) fprintf(fp, ",\"args\":{\"%s\":%lld}", e->argName, e->arg);
+            fputc('}', fp);
+            events++;
+        }
+        free(r);
+        traceRings[slot] = NULL;
+    }
+    fprintf(fp, "\n],\"otherData\":{\"dropped_events\":%lld}}\n", dropped);
+    fclose(fp);
+    fprintf(stderr, "Trace: %lld span(s) written to %s (%lld dropped)\n", events, tracePath, dropped);
 }
-int cmpNameDesc(const void *a, const void *b) { return -cmpNameAsc(a,b); }
 
-int cmpAvgAsc(const void *a, const void *b) {
-    const Student *x = (const Student *)a, *y = (const Student *)b;
-    if (x->average < y->average) return -1;
-    if (x->average > y->average) return  1;
-    return 0;
+void startTrace(const char *path) {
+    tracePath = path;
+    traceStart = nowSeconds();
+    timingOn = 1;
+    atexit(writeTrace);
 }
-int cmpAvgDesc(const void *a, const void *b) { return -cmpAvgAsc(a,b); }
 
-void sortMenu() {
-    if (studentCount == 0) { printf("No records.\n"); return; }
-    printf("\nSort by:\n");
-    printf("1) Roll (Asc)\n");
-    printf("2) Roll (Desc)\n");
-    printf("3) Name (Asc)\n");
-    printf("4) Name (Desc)\n");
-    printf("5) Average (Asc)\n");
-    printf("6) Average (Desc)\n");
-    int ch = inputIntInRange("Choose: ", 1, 6);
+/* --------------------- Metrics --------------------- */
+/*
+   Counters for the Prometheus textfile exposition (--metrics FILE).
+   Everything is noted from the thread running the command, so plain
+   integers suffice. Labelled series are small tables looked up by name,
+   growing as new labels appear (one per command at most), so every
+   command keeps its own series.
+*/
 
-    switch (ch) {
-        case 1: qsort(students, studentCount, sizeof(Student), cmpRollAsc); break;
-        case 2: qsort(students, studentCount, sizeof(Student), cmpRollDesc); break;
-        case 3: qsort(students, studentCount, sizeof(Student), cmpNameAsc); break;
-        case 4: qsort(students, studentCount, sizeof(Student), cmpNameDesc); break;
-        case 5: qsort(students, studentCount, sizeof(Student), cmpAvgAsc); break;
-        case 6: qsort(students, studentCount, sizeof(Student), cmpAvgDesc); break;
-    }
-    saveAll();
-    printf("✅ Sorted.\n");
-}
+#define LATENCY_BUCKETS 8
 
-/* -------------------- Statistics ------------------- */
+static const double latencyBounds[LATENCY_BUCKETS - 1] = { 1e-5, 1e-4, 1e-3, 1e-2, 0.1, 1.0, 10.0 };
 
-void showStats() {
-    if (studentCount == 0) { printf("No records.\n"); return; }
+typedef struct {
+    const char *label;
+    long count;
+    double seconds;
+    long buckets[LATENCY_BUCKETS];   // cumulative on output; last is +Inf
+} MetricSeries;
 
-    float classSum = 0.0f;
-    int gradeA=0, gradeB=0, gradeC=0, gradeD=0, gradeF=0;
-    int topIdx = 0, lowIdx = 0;
+typedef struct { MetricSeries *s; int used, cap; } MetricFamily;
 
-    for (int i = 0; i < studentCount; ++i) {
-        classSum += students[i].average;
-        if (students[i].average > students[topIdx].average) topIdx = i;
-        if (students[i].average < students[lowIdx].average) lowIdx = i;
-        switch (students[i].grade) {
-            case 'A': gradeA++; break;
-            case 'B': gradeB++; break;
-            case 'C': gradeC++; break;
-            case 'D': gradeD++; break;
-            default: gradeF++; break;
-        }
+static struct {
+    long loads, recordsLoaded, bytesRead;
+    double loadSeconds;
+    long saves, bytesWritten;
+    double saveSeconds;
+    MetricFamily searches, mutations, indexBuilds, commands, commandErrors;
+} metrics;
+
+static MetricSeries *metricSeries(MetricFamily *f, const char *label) {
+    for (int i = 0; i < f->used; ++i)
+        if (strcmp(f->s[i].label, label) == 0) return &f->s[i];
+    if (f->used == f->cap) {
+        static MetricSeries dropped;                        // out of memory: counted nowhere
+        int cap = f->cap ? f->cap * 2 : 16;
+        MetricSeries *grown = realloc(f->s, sizeof(MetricSeries) * (size_t)cap);
+        if (!grown) return &dropped;
+        f->s = grown;
+        f->cap = cap;
     }
+    f->s[f->used] = (MetricSeries){ .label = label };      // labels are string literals / command names
+    return &f->s[f->used++];
+}
 
-    float classAvg = classSum / studentCount;
+static void metricObserve(MetricFamily *f, const char *label, long long ns) {
+    MetricSeries *m = metricSeries(f, label);
+    double sec = ns / 1e9;
+    int b = 0;
+    while (b < LATENCY_BUCKETS - 1 && sec > latencyBounds[b]) b++;
+    m->count++;
+    m->seconds += sec;
+    m->buckets[b]++;
+}
 
-    printf("\n--- Statistics ---\n");
-    printf("Total students : %d\n", studentCount);
-    printf("Class average  : %.2f\n", classAvg);
-    printf("Topper         : Roll %d (%s) Avg %.2f\n", students[topIdx].roll, students[topIdx].name, students[topIdx].average);
-    printf("Lowest         : Roll %d (%s) Avg %.2f\n", students[lowIdx].roll, students[lowIdx].name, students[lowIdx].average);
-    printf("Grades         : A=%d, B=%d, C=%d, D=%d, F=%d\n", gradeA, gradeB, gradeC, gradeD, gradeF);
+// Instrumentation points shared by the USDT probes and the metrics.
+void noteSearch(const char *kind, const char *query, int hits, double t0) {
+    long long ns = nsSince(t0);
+    PROBE4(search, kind, query, hits, ns);
+    metricObserve(&metrics.searches, kind, ns);
+    traceSpan(kind, "search", t0, "hits", hits);
 }
 
-/* -------------------- Export Report ---------------- */
+// Returns the build time; a background build's metric is noted when its result is installed.
+long long noteIndexBuild(const char *index, int entries, double t0) {
+    long long ns = nsSince(t0);
+    PROBE3(index__build, index, entries, ns);
+    if (workerSlot != BACKGROUND_SLOT) metricObserve(&metrics.indexBuilds, index, ns);
+    traceSpan(index, "index", t0, "entries", entries);
+    return ns;
+}
+
+void noteMutation(const char *op, int roll) {
+    PROBE3(mutation, op, roll, studentCount);
+    metricSeries(&metrics.mutations, op)->count++;
+}
+
+/* --------------------- Workers --------------------- */
+/*
+   parallelFor splits [0, n) into one contiguous range per worker and
+   runs fn on each; the calling thread takes the last range. Falls back
+   to a single call for small inputs, inside a worker, or when threads
+   are unavailable. Workers are started on first use and then wait on
+   their pool for the next call, so a call costs a wake-up, not a thread.
+   Each worker keeps its slot, and so its own threadArena(). Background
+   threads have a pool of their own whose workers take the slots above
+   BACKGROUND_SLOT, so they never share one with the command thread's.
+   Either side may use up to BACKGROUND_SLOT threads (the --threads cap).
+*/
+
+typedef void (*RangeFn)(void *ctx, int begin, int end);
+
+static int workerThreads = 0;      // 0: one per online CPU
+
+int workerCount() {
+    if (workerThreads > 0) return workerThreads < BACKGROUND_SLOT ? workerThreads : BACKGROUND_SLOT;
+#ifdef _WIN32
+    return 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n < 1 ? 1 : (n > BACKGROUND_SLOT ? BACKGROUND_SLOT : (int)n);
+#endif
+}
+
+#ifndef _WIN32
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_mutex_t run;    // held for a whole call: one caller per pool at a time
+    pthread_cond_t wake, done;
+    int base;               // workers take slots base + 1, base + 2, ...
+    RangeFn fn;
+    void *ctx;
+    int n, parts;           // the current call: [0, n) in parts ranges
+    int active;             // workers taking part in it
+    int pending;            // of those, not yet finished
+    int spawned;            // workers started so far
+    long generation;        // bumped once per call
+} WorkerPool;
+
+#define WORKER_POOL(slotBase) { PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, \
+                                PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, (slotBase), \
+                                NULL, NULL, 0, 0, 0, 0, 0, 0 }
+
+// [0] serves the command thread, [1] the loader and index-builder threads
+static WorkerPool pools[2] = { WORKER_POOL(0), WORKER_POOL(BACKGROUND_SLOT) };
+
+static void *poolWorker(void *arg) {
+    int slot = (int)(intptr_t)arg;
+    WorkerPool *pool = &pools[slot > BACKGROUND_SLOT];
+    int k = slot - pool->base;
+    long seen = 0;
+    workerSlot = slot;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->generation == seen) pthread_cond_wait(&pool->wake, &pool->lock);
+        seen = pool->generation;
+        if (k > pool->active) continue;
+        RangeFn fn = pool->fn;
+        void *ctx = pool->ctx;
+        int begin = (int)((long)pool->n * (k - 1) / pool->parts), end = (int)((long)pool->n * k / pool->parts);
+        pthread_mutex_unlock(&pool->lock);
+        double t0 = spanStart();
+        fn(ctx, begin, end);
+        traceSpan("range", "worker", t0, "items", end - begin);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0) pthread_cond_signal(&pool->done);
+    }
+    return NULL;
+}
+#endif
+
+void parallelFor(int n, int minChunk, RangeFn fn, void *ctx) {
+    int threads = workerCount();
+    if (minChunk < 1) minChunk = 1;
+    if (threads > n / minChunk) threads = n / minChunk;
+#ifndef _WIN32
+    WorkerPool *pool = workerSlot == 0 ? &pools[0] : workerSlot == BACKGROUND_SLOT ? &pools[1] : NULL;
+    if (threads > 1 && pool) {
+        pthread_mutex_lock(&pool->run);
+        pthread_mutex_lock(&pool->lock);
+        while (pool->spawned < threads - 1) {
+            pthread_t tid;
+            if (pthread_create(&tid, NULL, poolWorker, (void *)(intptr_t)(pool->base + pool->spawned + 1)) != 0) break;
+            pthread_detach(tid);
+            pool->spawned++;
+        }
+        pool->fn = fn; pool->ctx = ctx;
+        pool->n = n; pool->parts = threads;
+        pool->active = pool->pending = pool->spawned < threads - 1 ? pool->spawned : threads - 1;
+        pool->generation++;
+        int started = pool->active;
+        pthread_cond_broadcast(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+        // anything not handed to a worker runs here
+        double t0 = spanStart();
+        int begin = (int)((long)n * started / threads);
+        fn(ctx, begin, n);
+        traceSpan("range", "worker", t0, "items", n - begin);
+        pthread_mutex_lock(&pool->lock);
+        while (pool->pending > 0) pthread_cond_wait(&pool->done, &pool->lock);
+        pthread_mutex_unlock(&pool->lock);
+        pthread_mutex_unlock(&pool->run);
+        traceSpan("parallelFor", "worker", t0, "threads", started + 1);
+        return;
+    }
+#endif
+    if (n > 0) fn(ctx, 0, n);
+}
+
+/* ------------------- UTF-8 Text -------------------- */
+/*
+   Names are UTF-8. Case-insensitive search and sorting compare a folded
+   copy of each name (Student.folded), computed whenever a name is set.
+   Folding applies Unicode simple case folding for Latin (incl. Latin-1,
+   Extended-A and Extended Additional), Greek, Cyrillic, Armenian and
+   fullwidth Latin; none of these mappings lengthens the UTF-8 encoding,
+   so the folded name always fits in MAX_NAME. Pure-ASCII names, the
+   common case, take an SSE2 path that lowercases 16 bytes at a time.
+*/
+
+static unsigned foldCodepoint(unsigned c) {
+    if (c < 0x80) return (c >= 'A' && c <= 'Z') ? c + 32 : c;
+    if (c < 0x100) {
+        if (c == 0xB5) return 0x3BC;                                 // micro sign -> mu
+        return (c >= 0xC0 && c <= 0xDE && c != 0xD7) ? c + 32 : c;
+    }
+    if (c <= 0x17F) {                                                // Latin Extended-A
+        if (c == 0x178) return 0xFF;
+        if (c == 0x17F) return 's';
+        if ((c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E)) return (c & 1) ? c + 1 : c;
+        if (c == 0x130 || c == 0x131 || c == 0x138 || c == 0x149) return c;
+        return (c & 1) ? c : c + 1;
+    }
+    if (c >= 0x386 && c <= 0x3AB) {                                 // Greek
+        if (c == 0x386) return 0x3AC;
+        if (c >= 0x388 && c <= 0x38A) return c + 37;
+        if (c == 0x38C) return 0x3CC;
+        if (c == 0x38E || c == 0x38F) return c + 63;
+        if (c >= 0x391 && c != 0x3A2) return c + 32;
+        return c;
+    }
+    if (c == 0x3C2) return 0x3C3;                                    // final sigma
+    if (c >= 0x400 && c <= 0x52F) {                                  // Cyrillic
+        if (c <= 0x40F) return c + 80;
+        if (c <= 0x42F) return c + 32;
+        if (c <= 0x45F) return c;
+        if ((c >= 0x460 && c <= 0x481) || (c >= 0x48A && c <= 0x4BF) || c >= 0x4D0)
+            return (c & 1) ? c : c + 1;
+        if (c == 0x4C0) return 0x4CF;
+        if (c >= 0x4C1 && c <= 0x4CE) return (c & 1) ? c + 1 : c;
+        return c;
+    }
+    if (c >= 0x531 && c <= 0x556) return c + 48;                     // Armenian
+    if (c >= 0x1E00 && c <= 0x1EFF) {                                // Latin Extended Additional
+        if (c == 0x1E9E) return 0xDF;
+        if (c <= 0x1E95 || c >= 0x1EA0) return (c & 1) ? c : c + 1;
+        return c;
+    }
+    if (c >= 0xFF21 && c <= 0xFF3A) return c + 32;                   // fullwidth A-Z
+    return c;
+}
+
+// Decodes one UTF-8 sequence; returns its length (invalid bytes decode as themselves, length 1).
+static int utf8Decode(const unsigned char *p, unsigned *cp) {
+    if (p[0] < 0x80) { *cp = p[0]; return 1; }
+    if ((p[0] & 0xE0) == 0xC0 && (p[1] & 0xC0) == 0x80) {
+        *cp = ((p[0] & 0x1Fu) << 6) | (p[1] & 0x3Fu);
+        return 2;
+    }
+    if ((p[0] & 0xF0) == 0xE0 && (p[1] & 0xC0) == 0x80 && (p[2] & 0xC0) == 0x80) {
+        *cp = ((p[0] & 0x0Fu) << 12) | ((p[1] & 0x3Fu) << 6) | (p[2] & 0x3Fu);
+        return 3;
+    }
+    if ((p[0] & 0xF8) == 0xF0 && (p[1] & 0xC0) == 0x80 && (p[2] & 0xC0) == 0x80 && (p[3] & 0xC0) == 0x80) {
+        *cp = ((p[0] & 0x07u) << 18) | ((p[1] & 0x3Fu) << 12) | ((p[2] & 0x3Fu) << 6) | (p[3] & 0x3Fu);
+        return 4;
+    }
+    *cp = 0xFFFFFFFFu;
+    return 1;
+}
+
+static int utf8Encode(unsigned cp, char *out) {
+    if (cp < 0x80)    { out[0] = (char)cp; return 1; }
+    if (cp < 0x800)   { out[0] = (char)(0xC0 | (cp >> 6)); out[1] = (char)(0x80 | (cp & 0x3F)); return 2; }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+// Lowercases ASCII in[0, n) into out; returns 0 at the first non-ASCII byte.
+static size_t foldAscii(const char *in, char *out, size_t n) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i before = _mm_set1_epi8('A' - 1), after = _mm_set1_epi8('Z' + 1), bit = _mm_set1_epi8(0x20);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+        if (_mm_movemask_epi8(v)) return 0;                 // high bit set: not ASCII
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, before), _mm_cmplt_epi8(v, after));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_or_si128(v, _mm_and_si128(upper, bit)));
+    }
+#endif
+    for (; i < n; ++i) {
+        unsigned char c = (unsigned char)in[i];
+        if (c >= 0x80) return 0;
+        out[i] = (char)((c >= 'A' && c <= 'Z') ? c + 32 : c);
+    }
+    return 1;
+}
+
+// Writes the case-folded form of in into out (size bytes, NUL-terminated).
+void foldName(const char *in, char *out, size_t size) {
+    size_t n = strlen(in);
+    if (n < size && foldAscii(in, out, n)) { out[n] = '\0'; return; }
+
+    const unsigned char *p = (const unsigned char *)in;
+    size_t used = 0;
+    while (*p) {
+        unsigned cp;
+        int len = utf8Decode(p, &cp);
+        char enc[4];
+        int elen = cp == 0xFFFFFFFFu ? (enc[0] = (char)*p, 1) : utf8Encode(foldCodepoint(cp), enc);
+        if (used + (size_t)elen >= size) break;
+        memcpy(out + used, enc, (size_t)elen);
+        used += (size_t)elen;
+        p += len;
+    }
+    out[used] = '\0';
+}
+
+// Drops an incomplete multi-byte sequence left at the end by a byte-bounded copy.
+void trimUtf8Tail(char *s) {
+    size_t n = strlen(s), i = n;
+    while (i > 0 && ((unsigned char)s[i - 1] & 0xC0) == 0x80) i--;
+    if (i == 0 || (unsigned char)s[i - 1] < 0xC0) return;
+    unsigned char lead = (unsigned char)s[i - 1];
+    size_t want = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : 2;
+    if (n - (i - 1) < want) s[i - 1] = '\0';
+}
+
+// Prints text in a column of width characters: truncated on a character boundary, then padded.
+void printPadded(FILE *fp, const char *text, int width) {
+    const unsigned char *p = (const unsigned char *)text;
+    int chars = 0;
+    while (*p && chars < width) {
+        unsigned cp;
+        int len = utf8Decode(p, &cp);
+        fwrite(p, 1, (size_t)len, fp);
+        p += len;
+        chars++;
+    }
+    for (; chars < width; ++chars) fputc(' ', fp);
+}
+
+/* ------------------- CSV Scanning ------------------ */
+/*
+   Structural indexing in the style of simdjson stage 1: the buffer is
+   processed in 64-byte blocks, each turned into bitmasks of commas,
+   quotes and newlines (SSE2 compares where available). A prefix-XOR of
+   the quote mask marks the bytes inside quoted fields, carried across
+   blocks, so delimiters inside quotes drop out and the remaining bits
+   are the field/row boundaries. Escaped quotes ("") toggle twice and
+   need no special casing. Field contents are unquoted when read.
+*/
+
+typedef struct {
+    unsigned *pos;      // offsets of unquoted ',' and '\n', in order
+    size_t    count, cap;
+} CsvIndex;
+
+static uint64_t prefixXor(uint64_t x) {
+    x ^= x << 1;  x ^= x << 2;  x ^= x << 4;
+    x ^= x << 8;  x ^= x << 16; x ^= x << 32;
+    return x;
+}
+
+static int lowestBit(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while (!(x & 1)) { x >>= 1; n++; }
+    return n;
+#endif
+}
+
+static void blockMasks(const unsigned char *p, uint64_t *comma, uint64_t *quote, uint64_t *nl) {
+#ifdef __SSE2__
+    const __m128i c = _mm_set1_epi8(','), q = _mm_set1_epi8('"'), n = _mm_set1_epi8('\n');
+    uint64_t mc = 0, mq = 0, mn = 0;
+    for (int k = 0; k < 4; ++k) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + 16 * k));
+        mc |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, c)) << (16 * k);
+        mq |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, q)) << (16 * k);
+        mn |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, n)) << (16 * k);
+    }
+    *comma = mc; *quote = mq; *nl = mn;
+#else
+    uint64_t mc = 0, mq = 0, mn = 0;
+    for (int i = 0; i < 64; ++i) {
+        mc |= (uint64_t)(p[i] == ',')  << i;
+        mq |= (uint64_t)(p[i] == '"')  << i;
+        mn |= (uint64_t)(p[i] == '\n') << i;
+    }
+    *comma = mc; *quote = mq; *nl = mn;
+#endif
+}
+
+// Builds the structural index of buf[0, len); returns 0 on allocation failure.
+int csvIndexBuild(const char *buf, size_t len, CsvIndex *ix) {
+    uint64_t inside = 0;                 // all ones while a quoted field spans blocks
+    ix->count = 0;
+    for (size_t base = 0; base < len; base += 64) {
+        unsigned char tail[64];
+        const unsigned char *p = (const unsigned char *)buf + base;
+        if (len - base < 64) {           // zero-pad the last partial block
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, p, len - base);
+            p = tail;
+        }
+        uint64_t comma, quote, nl;
+        blockMasks(p, &comma, &quote, &nl);
+        uint64_t quoted = prefixXor(quote) ^ inside;
+        inside = (uint64_t)((int64_t)quoted >> 63);
+        uint64_t structural = (comma | nl) & ~quoted;
+
+        if (ix->count + 64 > ix->cap) {
+            size_t ncap = ix->cap ? ix->cap * 2 : 4096;
+            unsigned *grown = realloc(ix->pos, sizeof(unsigned) * ncap);
+            if (!grown) return 0;
+            ix->pos = grown; ix->cap = ncap;
+        }
+        while (structural) {
+            ix->pos[ix->count++] = (unsigned)base + (unsigned)lowestBit(structural);
+            structural &= structural - 1;
+        }
+    }
+    return 1;
+}
+
+// Copies a raw (possibly quoted) field into out, undoing RFC 4180 quoting.
+void csvUnquote(const char *raw, char *out, size_t size) {
+    size_t n = 0;
+    if (*raw != '"') {
+        while (*raw && n + 1 < size) out[n++] = *raw++;
+    } else {
+        for (++raw; *raw && n + 1 < size; ++raw) {
+            if (*raw == '"') {
+                if (raw[1] != '"') break;    // closing quote
+                ++raw;                       // "" -> "
+            }
+            out[n++] = *raw;
+        }
+    }
+    out[n] = '\0';
+}
+
+// Writes one field, quoting it only when it contains CSV metacharacters.
+void writeCsvField(FILE *fp, const char *text) {
+    if (!strpbrk(text, ",\"\r\n")) { fputs(text, fp); return; }
+    fputc('"', fp);
+    for (const char *p = text; *p; ++p) {
+        if (*p == '"') fputc('"', fp);
+        fputc(*p, fp);
+    }
+    fputc('"', fp);
+}
+
+/* ------------------- Lazy Names -------------------- */
+/*
+   With --lazy-names, loadAll() leaves names in loadBuf and records only
+   their offsets. Single-record paths call studentName(); anything that
+   walks every name calls materializeNames() first, which copies them
+   all out in parallel and then releases the file buffer.
+*/
+
+void bloomNoteName(const char *folded);
+
+static void foldStudentName(Student *s) {
+    trimUtf8Tail(s->name);
+    foldName(s->name, s->folded, MAX_NAME);
+    bloomNoteName(s->folded);
+}
+
+// Call after writing s->name: keeps it valid UTF-8 and refreshes the folded copy.
+void nameChanged(Student *s) {
+    foldStudentName(s);
+    nameIndexStale = 1;
+    rosterDirty = 1;
+}
+
+// Filling in a loaded name changes nothing an index has seen.
+static void materializeName(Student *s) {
+    if (!s->lazyName) return;
+    csvUnquote(loadBuf + s->lazyName - 1, s->name, MAX_NAME);
+    foldStudentName(s);
+    s->lazyName = 0;
+}
+
+static void materializeRange(void *ctx, int begin, int end) {
+    (void)ctx;
+    for (int i = begin; i < end; ++i) materializeName(&students[i]);
+}
+
+void materializeNames() {
+    double t0 = spanStart();
+    if (namesPending) {
+        parallelFor(studentCount, 4096, materializeRange, NULL);
+        traceSpan("materializeNames", "load", t0, "records", studentCount);
+    }
+    namesPending = 0;
+    free(loadBuf);
+    loadBuf = NULL;
+}
+
+const char *studentName(Student *s) {
+    if (s->lazyName) { materializeName(s); namesPending--; }
+    return s->name;
+}
+
+void zoneTouched(int idx);          // students[idx] was edited in place
+
+/* ----------------- Record Versions ----------------- */
+/*
+   Every record carries a seqlock version: even while it is stable, odd
+   while a writer is replacing it. Readers copy a record without locking
+   and retry if the version moved underneath them (readStudent). Writers
+   edit a private copy and publish it with commitStudent(), which claims
+   the record by compare-and-swap from the version they read; if another
+   writer committed in between, the commit fails and the caller re-reads
+   (editStudent does so a few times) or reports the conflict. Edits of
+   different records never wait on each other.
+
+   This guards record contents only: a sort, delete or load moves records
+   and must not overlap readers or writers.
+*/
+
+#ifdef __SSE2__
+#define CPU_RELAX() _mm_pause()
+#else
+#define CPU_RELAX() ((void)0)
+#endif
+
+#define EDIT_ATTEMPTS 8
+
+// Consistent copy of students[idx]; returns the version it was taken at.
+unsigned readStudent(int idx, Student *out) {
+    Student *s = &students[idx];
+    for (;;) {
+        unsigned v = atomic_load_explicit(&s->version, memory_order_acquire);
+        if (v & 1) { CPU_RELAX(); continue; }               // a writer is mid-update
+        memcpy(out, s, offsetof(Student, version));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&s->version, memory_order_relaxed) == v) {
+            atomic_init(&out->version, v);
+            return v;
+        }
+    }
+}
+
+// Publishes next as students[idx] if the record is still at version seen. 0: conflict.
+int commitStudent(int idx, unsigned seen, const Student *next) {
+    Student *s = &students[idx];
+    unsigned expected = seen;
+    if (seen & 1) return 0;
+    if (!atomic_compare_exchange_strong_explicit(&s->version, &expected, seen + 1,
+                                                 memory_order_relaxed, memory_order_relaxed)) return 0;
+    atomic_thread_fence(memory_order_release);              // readers see the odd version before any new byte
+    memcpy(s, next, offsetof(Student, version));
+    atomic_store_explicit(&s->version, seen + 2, memory_order_release);
+    zoneTouched(idx);
+    return 1;
+}
+
+typedef int (*StudentEditFn)(Student *s, void *ctx);       // 0: leave the record alone
+
+/*
+   Applies fn to a copy of students[idx] and commits it, re-reading and
+   re-applying on conflict up to `attempts` times. 1: committed; 0: fn
+   declined; -1: other writers kept winning.
+*/
+int editStudent(int idx, StudentEditFn fn, void *ctx, int attempts) {
+    Student s;
+    for (int a = 0; a < attempts; ++a) {
+        unsigned seen = readStudent(idx, &s);
+        if (!fn(&s, ctx)) return 0;
+        if (commitStudent(idx, seen, &s)) return 1;
+    }
+    return -1;
+}
+
+/* ------------------- Bulk Builds ------------------- */
+/*
+   Indexes are rebuilt whole after loads, imports and sorts. Inserting
+   key by key sends every insert to a random cache line of a table far
+   larger than cache, so whole builds go through BulkItems instead:
+
+   1. gather     every record's key (hash, Bloom key, sort key) in
+                 parallel over the roster
+   2. partition  a stable parallel counting sort on the high bits of
+                 the key's destination (hash slot, Bloom block, rank)
+   3. fill       each worker owns a contiguous run of buckets, so it
+                 writes one small neighbourhood of the structure at a
+                 time and never touches memory another worker writes
+
+   Linear probing can run a cluster past the end of a worker's region;
+   those few items are placed afterwards, in order, by the caller. With a
+   single worker the partition pass costs more than it saves, so the
+   gathered items are placed directly. Ordered indexes (the sorted roll
+   tree, the word list) sort their items with a radix sort instead and
+   are then laid out bottom-up.
+*/
+
+typedef struct {
+    uint64_t key;       // destination hash or sort key
+    int idx;            // record
+    int aux;            // per index: roll, word offset
+} BulkItem;
+
+#define BULK_FANOUT 1024            // partition buckets per pass: more would thrash the TLB while scattering
+#define BULK_RADIX_BITS 10
+
+static int bulkParts(int n) {
+    int parts = workerCount();
+    return n / 4096 + 1 < parts ? n / 4096 + 1 : parts;
+}
+
+static int log2u(unsigned v) {
+    int k = 0;
+    while (v > 1) { v >>= 1; k++; }
+    return k;
+}
+
+typedef void (*BulkKeyFn)(BulkItem *it, int idx, const void *ctx);
+
+typedef struct {
+    BulkItem *items;
+    BulkKeyFn key;
+    const void *ctx;
+} BulkGather;
+
+static void bulkGatherRange(void *ctx, int begin, int end) {
+    BulkGather *g = ctx;
+    for (int i = begin; i < end; ++i) {
+        g->items[i].idx = i;
+        g->key(&g->items[i], i, g->ctx);
+    }
+}
+
+// items[i] = key(students[i]) for i < n, in fresh memory; NULL if out of memory.
+static BulkItem *bulkGather(int n, BulkKeyFn key, const void *ctx) {
+    BulkGather g = { malloc(sizeof(BulkItem) * (size_t)(n ? n : 1)), key, ctx };
+    if (g.items) parallelFor(n, 4096, bulkGatherRange, &g);
+    return g.items;
+}
+
+typedef struct {
+    const BulkItem *in;
+    BulkItem *out;
+    int n, parts, buckets, shift;
+    int *counts;        // [part][bucket]: item count, then that run's first output position
+} BulkPartition;
+
+static int bulkBucket(const BulkPartition *bp, const BulkItem *it) {
+    return (int)((it->key >> bp->shift) & (uint64_t)(bp->buckets - 1));
+}
+
+static void bulkCount(void *ctx, int begin, int end) {
+    BulkPartition *bp = ctx;
+    for (int p = begin; p < end; ++p) {
+        int *c = bp->counts + (size_t)p * bp->buckets;
+        int to = (int)((long)bp->n * (p + 1) / bp->parts);
+        for (int i = (int)((long)bp->n * p / bp->parts); i < to; ++i) c[bulkBucket(bp, &bp->in[i])]++;
+    }
+}
+
+static void bulkScatter(void *ctx, int begin, int end) {
+    BulkPartition *bp = ctx;
+    for (int p = begin; p < end; ++p) {
+        int *c = bp->counts + (size_t)p * bp->buckets;
+        int to = (int)((long)bp->n * (p + 1) / bp->parts);
+        for (int i = (int)((long)bp->n * p / bp->parts); i < to; ++i) bp->out[c[bulkBucket(bp, &bp->in[i])]++] = bp->in[i];
+    }
+}
+
+/*
+   Stable partition of in[0, n) into out on (key >> shift) & (buckets - 1),
+   buckets a power of two. start[b] receives bucket b's first position and
+   start[buckets] = n. 0 if out of memory.
+*/
+static int bulkPartition(const BulkItem *in, BulkItem *out, int n, int shift, int buckets, int *start) {
+    BulkPartition bp = { in, out, n, bulkParts(n), buckets, shift, NULL };
+    bp.counts = calloc((size_t)bp.parts * (size_t)buckets, sizeof(int));
+    if (!bp.counts) return 0;
+    parallelFor(bp.parts, 1, bulkCount, &bp);
+    int pos = 0;
+    for (int b = 0; b < buckets; ++b) {                     // bucket-major, part-minor: stays stable
+        start[b] = pos;
+        for (int p = 0; p < bp.parts; ++p) {
+            int *c = &bp.counts[(size_t)p * buckets + b];
+            int k = *c;
+            *c = pos;
+            pos += k;
+        }
+    }
+    start[buckets] = n;
+    parallelFor(bp.parts, 1, bulkScatter, &bp);
+    free(bp.counts);
+    return 1;
+}
+
+// Places one item; 0 if its probe would reach slot `limit` first (limit 0: never stops).
+typedef int (*BulkPlaceFn)(void *table, const BulkItem *it, unsigned limit);
+
+typedef struct {
+    BulkItem *items;
+    const int *start;
+    int buckets, parts;
+    unsigned bucketSlots;
+    BulkPlaceFn place;
+    void *table;
+    int *kept;          // per part: items left over at the front of its range
+} BulkFill;
+
+static void bulkFillParts(void *ctx, int begin, int end) {
+    BulkFill *f = ctx;
+    for (int p = begin; p < end; ++p) {
+        int b0 = (int)((long)f->buckets * p / f->parts), b1 = (int)((long)f->buckets * (p + 1) / f->parts);
+        unsigned limit = (unsigned)b1 * f->bucketSlots;
+        int first = f->start[b0], kept = 0;
+        for (int i = first; i < f->start[b1]; ++i)
+            if (!f->place(f->table, &f->items[i], limit)) f->items[first + kept++] = f->items[i];
+        f->kept[p] = kept;
+    }
+}
+
+/*
+   Places items[0, n) into a table of `slots` slots (a power of two); an
+   item's home slot is (key >> keyShift) & (slots - 1). Items sharing a
+   home are placed in their order in items. 0 if out of memory, with the
+   table untouched.
+*/
+static int bulkFill(const BulkItem *items, int n, unsigned slots, int keyShift, BulkPlaceFn place, void *table) {
+    if (bulkParts(n) < 2) {                                 // a single worker gains nothing from partitioning
+        for (int i = 0; i < n; ++i) place(table, &items[i], 0);
+        return 1;
+    }
+    unsigned bucketSlots = slots > BULK_FANOUT ? slots / BULK_FANOUT : 1;
+    BulkFill f = { malloc(sizeof(BulkItem) * (size_t)(n ? n : 1)), NULL, (int)(slots / bucketSlots), bulkParts(n),
+                   bucketSlots, place, table, NULL };
+    int *start = malloc(sizeof(int) * ((size_t)f.buckets + 1));
+    if (f.parts > f.buckets) f.parts = f.buckets;
+    f.kept = malloc(sizeof(int) * (size_t)f.parts);
+    int ok = f.items && start && f.kept && bulkPartition(items, f.items, n, keyShift + log2u(bucketSlots), f.buckets, start);
+    if (ok) {
+        f.start = start;
+        parallelFor(f.parts, 1, bulkFillParts, &f);
+        for (int p = 0; p < f.parts; ++p) {                 // clusters that ran past a region's end
+            const BulkItem *left = f.items + start[(int)((long)f.buckets * p / f.parts)];
+            for (int k = 0; k < f.kept[p]; ++k) place(table, &left[k], 0);
+        }
+    }
+    free(f.items);
+    free(start);
+    free(f.kept);
+    return ok;
+}
+
+/*
+   Stable LSD radix sort of items[0, n) on the low `bits` bits of key, one
+   BULK_RADIX_BITS digit per partition pass (skipping digits no two keys
+   differ in), so equal keys keep their order.
+   0 if out of memory, with items untouched.
+*/
+static int bulkRadixSort(BulkItem *items, int n, int bits) {
+    BulkItem *tmp = malloc(sizeof(BulkItem) * (size_t)(n ? n : 1)), *a = items, *b = tmp;
+    int *start = malloc(sizeof(int) * (BULK_FANOUT + 1));
+    int ok = tmp && start;
+    uint64_t vary = 0;                                      // key bits that are not the same everywhere
+    for (int k = 1; k < n; ++k) vary |= items[k].key ^ items[0].key;
+    for (int shift = 0; ok && shift < bits; shift += BULK_RADIX_BITS) {
+        if (!((vary >> shift) & (BULK_FANOUT - 1))) continue;
+        ok = bulkPartition(a, b, n, shift, BULK_FANOUT, start);
+        BulkItem *t = a; a = b; b = t;
+    }
+    if (ok && a != items) memcpy(items, a, sizeof(BulkItem) * (size_t)n);
+    free(tmp);
+    free(start);
+    return ok;
+}
+
+/* ------------------ Bloom Filters ------------------ */
+/*
+   Split-block Bloom filters over rolls and folded full names. Each key
+   maps to one 64-byte block and sets one bit in each of its eight words,
+   so a query touches a single cache line. A negative answer is exact, so
+   lookups for rolls or names that do not exist return without touching
+   the store or its indexes.
+
+   Keys are added as they appear (appends, renames). Removals leave stale
+   bits behind, which only cost false positives; the filter is rebuilt
+   ("compacted") when it was built for far more or far fewer keys than
+   the roster now holds, and after every load.
+*/
+
+#define BLOOM_BITS_PER_KEY 16       // ~0.1% false positives
+
+typedef struct { uint64_t w[8]; } BloomBlock;
+
+typedef struct {
+    BloomBlock *blocks;
+    unsigned mask;                  // block count - 1
+    long keys;                      // keys added since the last build
+    long sized;                     // keys the filter was sized for
+    int stale;
+} Bloom;
+
+static Bloom rollBloom = { NULL, 0, 0, 0, 1 };
+static Bloom nameBloom = { NULL, 0, 0, 0, 1 };
+
+static const uint32_t bloomSalt[8] = {
+    0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+    0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u
+};
+
+static uint64_t mix64(uint64_t h) {
+    h ^= h >> 33; h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ull;
+    return h ^ (h >> 33);
+}
+
+static uint64_t bloomKeyRoll(int roll) { return mix64((uint64_t)(unsigned)roll); }
+
+static uint64_t bloomKeyName(const char *folded) {
+    uint64_t h = 1469598103934665603ull;                    // FNV-1a 64
+    while (*folded) { h ^= (unsigned char)*folded++; h *= 1099511628211ull; }
+    return mix64(h);
+}
+
+static void bloomSet(Bloom *b, uint64_t key) {
+    BloomBlock *blk = &b->blocks[(key >> 32) & b->mask];
+    uint32_t lo = (uint32_t)key;
+    for (int i = 0; i < 8; ++i) blk->w[i] |= 1ull << ((lo * bloomSalt[i]) >> 26);
+}
+
+static void bloomAdd(Bloom *b, uint64_t key) {
+    bloomSet(b, key);
+    b->keys++;
+}
+
+static int bloomPlace(void *table, const BulkItem *it, unsigned limit) {
+    (void)limit;
+    bloomSet(table, it->key);
+    return 1;
+}
+
+static void rollBloomKey(BulkItem *it, int idx, const void *ctx) {
+    (void)ctx;
+    it->key = bloomKeyRoll(students[idx].roll);
+}
+
+static void nameBloomKey(BulkItem *it, int idx, const void *ctx) {
+    (void)ctx;
+    it->key = bloomKeyName(students[idx].folded);
+}
+
+// Refills a freshly reset filter from the whole roster, block range by block range.
+static int bloomBuild(Bloom *b, BulkKeyFn key) {
+    BulkItem *items = bulkGather(studentCount, key, NULL);
+    int ok = items && bulkFill(items, studentCount, b->mask + 1, 32, bloomPlace, b);
+    free(items);
+    if (ok) b->keys = studentCount;
+    return ok;
+}
+
+static int bloomMayContain(const Bloom *b, uint64_t key) {
+    const BloomBlock *blk = &b->blocks[(key >> 32) & b->mask];
+    uint32_t lo = (uint32_t)key;
+    uint64_t miss = 0;
+    for (int i = 0; i < 8; ++i) miss |= ~blk->w[i] & (1ull << ((lo * bloomSalt[i]) >> 26));
+    return miss == 0;
+}
+
+// Sizes an empty filter for n keys (with room to grow). 0 on failure.
+static int bloomReset(Bloom *b, long n) {
+    long want = (n < 1024 ? 1024 : n) * 2;
+    unsigned blocks = 1;
+    while ((long)blocks * 512 < want * BLOOM_BITS_PER_KEY / 2 && blocks < (1u << 28)) blocks <<= 1;
+    if (!b->blocks || blocks != b->mask + 1) {
+        BloomBlock *grown = bigAlloc(sizeof(BloomBlock) * blocks);
+        if (!grown) return 0;
+        bigFree(b->blocks);
+        b->blocks = grown;
+        b->mask = blocks - 1;
+    }
+    memset(b->blocks, 0, sizeof(BloomBlock) * blocks);
+    b->keys = 0;
+    b->sized = want;
+    b->stale = 0;
+    return 1;
+}
+
+// Stale, overfilled, or mostly describing deleted records.
+static int bloomNeedsBuild(const Bloom *b) {
+    return b->stale || b->keys > b->sized || b->keys > 2L * studentCount + 1024;
+}
+
+static int ensureRollBloom() {
+    if (!bloomNeedsBuild(&rollBloom)) return 1;
+    double t0 = spanStart();
+    if (!bloomReset(&rollBloom, studentCount) || !bloomBuild(&rollBloom, rollBloomKey)) { rollBloom.stale = 1; return 0; }
+    noteIndexBuild("roll_bloom", studentCount, t0);
+    return 1;
+}
+
+static int ensureNameBloom() {
+    if (!bloomNeedsBuild(&nameBloom)) return 1;
+    materializeNames();
+    double t0 = spanStart();
+    if (!bloomReset(&nameBloom, studentCount) || !bloomBuild(&nameBloom, nameBloomKey)) { nameBloom.stale = 1; return 0; }
+    noteIndexBuild("name_bloom", studentCount, t0);
+    return 1;
+}
+
+// 0 only if no record has this roll. 1 when unsure (or no filter).
+int rollMayExist(int roll) {
+    return !ensureRollBloom() || bloomMayContain(&rollBloom, bloomKeyRoll(roll));
+}
+
+// Same for a folded full name.
+int nameMayExist(const char *folded) {
+    return !ensureNameBloom() || bloomMayContain(&nameBloom, bloomKeyName(folded));
+}
+
+// Called for every new roll / folded name entering the roster.
+void bloomNoteRoll(int roll) {
+    if (!bloomNeedsBuild(&rollBloom)) bloomAdd(&rollBloom, bloomKeyRoll(roll));
+}
+
+void bloomNoteName(const char *folded) {
+    if (!bloomNeedsBuild(&nameBloom)) bloomAdd(&nameBloom, bloomKeyName(folded));
+}
+
+// Whole roster replaced: rebuild both filters on next use.
+void bloomsInvalidate() {
+    rollBloom.stale = 1;
+    nameBloom.stale = 1;
+}
+
+/* -------------------- Name Scan -------------------- */
+/*
+   Full scan of the folded-name column, used when no index can answer a
+   query. The roster is cut into fixed chunks that workers claim in
+   increasing order; each chunk's hits land in that chunk's own slice of
+   the output, so merging is a concatenation in roster order. With a
+   limit, workers stop claiming new chunks once enough hits exist; every
+   chunk claimed before that still finishes, so the claimed chunks form
+   a prefix of the roster and the first `limit` hits are exact.
+
+   Patterns may use '*' (any run) and '?' (one character); a pattern
+   matches anywhere in the name, like a plain substring query.
+*/
+
+#define SCAN_CHUNK 2048
+
+typedef struct {
+    const char *pattern;        // folded query
+    int wildcard;
+    int limit;                  // 0: no limit
+    int begin, end;             // roster range to scan
+    int *hits;                  // hits[chunkStart - begin + k]: k-th hit of that chunk
+    int *chunkHits;             // hit count per chunk
+    int chunks;
+    atomic_int nextChunk;
+    atomic_int found;
+} NameScan;
+
+// Glob match of p against the whole of s; '?' and each retry after '*' step one UTF-8 character.
+static int globMatch(const char *p, const char *s) {
+    const char *star = NULL, *resume = NULL;
+    unsigned cp;
+    while (*s) {
+        if (*p == '?') {
+            p++;
+            s += utf8Decode((const unsigned char *)s, &cp);
+        } else if (*p == '*') {
+            star = ++p;
+            resume = s;
+        } else if (*p == *s) {
+            p++; s++;
+        } else if (star) {
+            p = star;
+            s = resume += utf8Decode((const unsigned char *)resume, &cp);
+        } else {
+            return 0;
+        }
+    }
+    while (*p == '*') p++;
+    return !*p;
+}
+
+static int nameMatches(const NameScan *q, const char *folded) {
+    return q->wildcard ? globMatch(q->pattern, folded) : strstr(folded, q->pattern) != NULL;
+}
+
+static void scanWorker(void *ctx, int begin, int end) {
+    NameScan *q = (NameScan *)ctx;
+    (void)begin; (void)end;
+    while (!q->limit || atomic_load(&q->found) < q->limit) {
+        int c = atomic_fetch_add(&q->nextChunk, 1);
+        if (c >= q->chunks) break;
+        int from = q->begin + c * SCAN_CHUNK, to = from + SCAN_CHUNK;
+        if (to > q->end) to = q->end;
+        int n = 0;
+        for (int i = from; i < to; ++i)
+            if (nameMatches(q, students[i].folded)) q->hits[from - q->begin + n++] = i;
+        q->chunkHits[c] = n;
+        atomic_fetch_add(&q->found, n);
+    }
+}
+
+/*
+   Scans students[begin, end) for query (folded here) and writes matching
+   indices, in roster order, to out (room for end - begin entries).
+   Returns the hit count, at most limit when limit > 0.
+*/
+int scanNameRange(const char *query, int limit, int *out, int begin, int end) {
+    char folded[MAX_NAME * 2], pattern[MAX_NAME * 2 + 2];
+    foldName(query, folded, sizeof(folded));
+
+    NameScan q;
+    q.wildcard = strpbrk(folded, "*?") != NULL;
+    if (q.wildcard) snprintf(pattern, sizeof(pattern), "*%s*", folded);
+    q.pattern = q.wildcard ? pattern : folded;
+    q.limit = limit > 0 ? limit : 0;
+    q.begin = begin;
+    q.end = end;
+    q.chunks = (end - begin + SCAN_CHUNK - 1) / SCAN_CHUNK;
+    q.hits = arenaAlloc(threadArena(), sizeof(int) * (end > begin ? end - begin : 1));
+    q.chunkHits = arenaAlloc(threadArena(), sizeof(int) * (q.chunks ? q.chunks : 1));
+    atomic_init(&q.nextChunk, 0);
+    atomic_init(&q.found, 0);
+    if (!q.hits || !q.chunkHits) return 0;
+    memset(q.chunkHits, 0, sizeof(int) * q.chunks);
+
+    int workers = workerCount() < q.chunks ? workerCount() : q.chunks;
+    parallelFor(workers, 1, scanWorker, &q);
+
+    // claimed chunks are a prefix; concatenate their slices in order
+    int total = 0, claimed = atomic_load(&q.nextChunk);
+    if (claimed > q.chunks) claimed = q.chunks;
+    for (int c = 0; c < claimed && (!q.limit || total < q.limit); ++c)
+        for (int k = 0; k < q.chunkHits[c] && (!q.limit || total < q.limit); ++k)
+            out[total++] = q.hits[c * SCAN_CHUNK + k];
+    return total;
+}
+
+int scanNames(const char *query, int limit, int *out) {
+    return scanNameRange(query, limit, out, 0, studentCount);
+}
+
+/* -------------------- Roll Index ------------------- */
+/*
+   Open-addressing hash table: roll -> position in students[].
+   Anything that moves records (load, delete, sort) only marks it stale;
+   the next lookup rebuilds it. Appends are inserted in place.
+*/
+
+typedef struct { int roll; int idx; } RollSlot;   // idx < 0: empty
+
+static RollSlot *rollSlots = NULL;
+static unsigned rollMask = 0;       // capacity - 1 (capacity is a power of two)
+static int rollIndexStale = 1;
+static int sortedRollLookups = 0;   // --roll-index sorted: point lookups use the Eytzinger index
+
+// Index files (FILE.idx) and the background builder, defined further down.
+int indexBuildBusy();
+int indexMapped(const void *p);     // arrays adopted from FILE.idx are never freed
+void releaseIndexMap();             // unmaps FILE.idx once no index points into it
+
+// Progressive startup, defined with loadAll().
+int loadBusy();
+int findLoadingRoll(int roll);
+
+static unsigned hashRoll(int roll) {
+    unsigned h = (unsigned)roll * 2654435761u;
+    return h ^ (h >> 16);
+}
+
+static void rollSlotInsert(RollSlot *slots, unsigned mask, int roll, int idx) {
+    unsigned i = hashRoll(roll) & mask;
+    while (slots[i].idx >= 0 && slots[i].roll != roll) i = (i + 1) & mask;
+    slots[i].roll = roll;
+    slots[i].idx = idx;
+}
+
+static void rollIndexInsert(int roll, int idx) {
+    rollSlotInsert(rollSlots, rollMask, roll, idx);
+}
+
+typedef struct { RollSlot *slots; unsigned mask; } RollTable;
+
+static void rollSlotKey(BulkItem *it, int idx, const void *ctx) {
+    (void)ctx;
+    it->aux = students[idx].roll;
+    it->key = hashRoll(it->aux);
+}
+
+// rollSlotInsert() for bulkFill(): a later record with the same roll takes the slot over.
+static int rollPlace(void *table, const BulkItem *it, unsigned limit) {
+    RollTable *t = table;
+    for (unsigned i = (unsigned)it->key & t->mask;;) {
+        if (t->slots[i].idx < 0 || t->slots[i].roll == it->aux) {
+            t->slots[i].roll = it->aux;
+            t->slots[i].idx = it->idx;
+            return 1;
+        }
+        if (++i == limit) return 0;
+        i &= t->mask;
+    }
+}
+
+/*
+   Fills a table for students[0, n), reusing `reuse` when it already has
+   the right capacity. Touches no globals, so the background builder can
+   run it. NULL if out of memory.
+*/
+static RollSlot *buildRollSlots(int n, RollSlot *reuse, unsigned reuseMask, unsigned *mask) {
+    unsigned cap = 16;
+    while (cap < (unsigned)n * 2) cap <<= 1;                // load factor <= 0.5
+    RollSlot *slots = reuse && reuseMask == cap - 1 ? reuse : bigAlloc(sizeof(RollSlot) * cap);
+    if (!slots) return NULL;
+    for (unsigned i = 0; i < cap; ++i) slots[i].idx = -1;
+    RollTable t = { slots, cap - 1 };
+    BulkItem *items = bulkGather(n, rollSlotKey, NULL);
+    if (!items || !bulkFill(items, n, cap, 0, rollPlace, &t))
+        for (int i = 0; i < n; ++i) rollSlotInsert(slots, cap - 1, students[i].roll, i);   // no memory to spare
+    free(items);
+    *mask = cap - 1;
+    return slots;
+}
+
+static void installRollIndex(RollSlot *slots, unsigned mask) {
+    RollSlot *old = rollSlots;
+    rollSlots = slots;
+    rollMask = mask;
+    rollIndexStale = 0;
+    if (old != slots && !indexMapped(old)) bigFree(old);
+    releaseIndexMap();
+}
+
+static void rebuildRollIndex() {
+    double t0 = spanStart();
+    unsigned mask;
+    RollSlot *slots = buildRollSlots(studentCount, rollSlots, rollMask, &mask);
+    if (!slots) return;                                     // stays stale: lookups scan
+    installRollIndex(slots, mask);
+    noteIndexBuild("roll", studentCount, t0);
+}
+
+// Call after any change that moves or removes records.
+void rosterChanged() {
+    rollIndexStale = 1;
+    dupIndexStale = 1;
+    sortedRollStale = 1;
+    nameIndexStale = 1;
+    zoneMapStale = 1;
+    rosterDirty = 1;
+}
+
+// Call after appending students[idx].
+void dupIndexAppended(int idx);
+void zoneAppended(int idx);
+
+void studentAppended(int idx) {
+    bloomNoteRoll(students[idx].roll);
+    dupIndexAppended(idx);
+    zoneAppended(idx);
+    if (!rollIndexStale && (unsigned)studentCount * 2 <= rollMask + 1)
+        rollIndexInsert(students[idx].roll, idx);
+    else
+        rollIndexStale = 1;
+    sortedRollStale = 1;
+    nameIndexStale = 1;
+    rosterDirty = 1;
+}
+
+int findIndexByRollSorted(int roll);
+
+int findIndexByRoll(int roll) {
+    if (loadBusy()) return findLoadingRoll(roll);
+    if (!rollMayExist(roll)) return -1;
+    if (!sortedRollLookups && rollIndexStale && !indexBuildBusy()) rebuildRollIndex();
+    if (sortedRollLookups || rollIndexStale) {
+        int idx = findIndexByRollSorted(roll);
+        if (idx != -2) return idx;
+    }
+    if (rollIndexStale) {
+        for (int i = 0; i < studentCount; ++i)
+            if (students[i].roll == roll) return i;
+        return -1;
+    }
+    for (unsigned i = hashRoll(roll) & rollMask; rollSlots[i].idx >= 0; i = (i + 1) & rollMask)
+        if (rollSlots[i].roll == roll) return rollSlots[i].idx;
+    return -1;
+}
+
+/* ---------------- Sorted Roll Index ---------------- */
+/*
+   Rolls sorted ascending and stored in Eytzinger (BFS) order: node k has
+   children 2k and 2k+1, slot 0 is unused. A lower-bound search walks one
+   root-to-leaf path with no unpredictable branches, prefetching the
+   descendants four levels down (16 slots = two cache lines). Unlike the
+   hash index it answers range queries and iterates in roll order.
+   Rebuilt lazily after any roster change, like the other indexes.
+*/
+
+static RollSlot *rollTree = NULL;   // [1..rollTreeSize]
+static int rollTreeSize = 0;
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PREFETCH(p) __builtin_prefetch(p)
+#else
+#define PREFETCH(p) ((void)0)
+#endif
+
+static int cmpRollSlot(const void *a, const void *b) {
+    const RollSlot *x = a, *y = b;
+    if (x->roll != y->roll) return x->roll < y->roll ? -1 : 1;
+    return x->idx - y->idx;
+}
+
+// In-order walk of the implicit tree of n slots, assigning sorted[] in sequence.
+static int fillRollTree(RollSlot *tree, int n, const RollSlot *sorted, int next, int k) {
+    if (k > n) return next;
+    next = fillRollTree(tree, n, sorted, next, 2 * k);
+    tree[k] = sorted[next++];
+    return fillRollTree(tree, n, sorted, next, 2 * k + 1);
+}
+
+// Sorts (idx-ordered) pairs like cmpRollSlot by a radix sort on roll - min. 0 if out of memory.
+static int bulkSortRolls(RollSlot *sorted, int n) {
+    BulkItem *items = malloc(sizeof(BulkItem) * (size_t)(n ? n : 1));
+    if (!items) return 0;
+    int lo = n ? sorted[0].roll : 0, hi = lo;
+    for (int i = 1; i < n; ++i) {
+        if (sorted[i].roll < lo) lo = sorted[i].roll;
+        if (sorted[i].roll > hi) hi = sorted[i].roll;
+    }
+    for (int i = 0; i < n; ++i) {
+        items[i].key = (uint64_t)((int64_t)sorted[i].roll - lo);
+        items[i].idx = sorted[i].idx;
+    }
+    int ok = bulkRadixSort(items, n, log2u((unsigned)((int64_t)hi - lo)) + 1);
+    for (int i = 0; ok && i < n; ++i) {
+        sorted[i].roll = (int)(lo + (int64_t)items[i].key);
+        sorted[i].idx = items[i].idx;
+    }
+    free(items);
+    return ok;
+}
+
+// Nodes in the subtree of node k, in a tree of n nodes.
+static int subtreeSize(int k, int n) {
+    int size = 0;
+    for (long lo = k, hi = k; lo <= n; lo = 2 * lo, hi = 2 * hi + 1) size += (int)((hi < n ? hi : n) - lo + 1);
+    return size;
+}
+
+// Sorted rank of the leftmost node in k's subtree.
+static int subtreeFirst(int k, int n) {
+    int first = 0;
+    for (int d = log2u((unsigned)k) - 1; d >= 0; --d)
+        if ((k >> d) & 1) first += subtreeSize((k >> (d + 1)) * 2, n) + 1;   // right turn: skip the left subtree and parent
+    return first;
+}
+
+typedef struct { RollSlot *tree; const RollSlot *sorted; int n, top; } TreeFill;
+
+static void fillTreeRange(void *ctx, int begin, int end) {
+    TreeFill *f = ctx;
+    for (int r = f->top + begin; r < f->top + end; ++r)
+        fillRollTree(f->tree, f->n, f->sorted, subtreeFirst(r, f->n), r);
+}
+
+// Tree over students[0, n) in fresh memory, touching no globals; NULL if out of memory.
+static RollSlot *buildRollTree(int n) {
+    RollSlot *sorted = malloc(sizeof(RollSlot) * (size_t)(n ? n : 1));
+    RollSlot *tree = bigAlloc(sizeof(RollSlot) * (size_t)(n + 1));
+    if (!sorted || !tree) { free(sorted); bigFree(tree); return NULL; }
+
+    int inOrder = 1;
+    for (int i = 0; i < n; ++i) {
+        sorted[i].roll = students[i].roll;
+        sorted[i].idx = i;
+        if (i && sorted[i].roll < sorted[i - 1].roll) inOrder = 0;
+    }
+    if (!inOrder && !bulkSortRolls(sorted, n)) qsort(sorted, n, sizeof(RollSlot), cmpRollSlot);   // usually already sorted
+
+    // the few nodes above level `top` directly, then the subtrees rooted on it in parallel
+    tree[0].roll = tree[0].idx = 0;
+    int top = 1;
+    while (top < 4 * workerCount() && 2 * top <= n) top *= 2;
+    for (int k = 1; k < top; ++k) tree[k] = sorted[subtreeFirst(k, n) + subtreeSize(2 * k, n)];
+    TreeFill f = { tree, sorted, n, top };
+    parallelFor((2 * top < n + 1 ? 2 * top : n + 1) - top, 1, fillTreeRange, &f);
+    free(sorted);
+    return tree;
+}
+
+static void installRollTree(RollSlot *tree, int n) {
+    RollSlot *old = rollTree;
+    rollTree = tree;
+    rollTreeSize = n;
+    sortedRollStale = 0;
+    if (!indexMapped(old)) bigFree(old);
+    releaseIndexMap();
+}
+
+static void rebuildSortedRolls() {
+    double t0 = spanStart();
+    RollSlot *tree = buildRollTree(studentCount);
+    if (!tree) return;
+    installRollTree(tree, studentCount);
+    noteIndexBuild("sorted_roll", studentCount, t0);
+}
+
+// Tree slot of the first roll >= roll, or 0 if every roll is smaller.
+static int rollLowerBound(int roll) {
+    int k = 1;
+    while (k <= rollTreeSize) {
+        PREFETCH(rollTree + 16 * k);
+        k = 2 * k + (rollTree[k].roll < roll);
+    }
+    // climb back past the right turns taken below the answer
+#if defined(__GNUC__) || defined(__clang__)
+    k >>= __builtin_ffs(~k);
+#else
+    while (k & 1) k >>= 1;
+    k >>= 1;
+#endif
+    return k;
+}
+
+// In-order successor of slot k, or 0 after the last.
+static int rollTreeNext(int k) {
+    if (2 * k + 1 <= rollTreeSize) {
+        k = 2 * k + 1;
+        while (2 * k <= rollTreeSize) k *= 2;
+        return k;
+    }
+    while (k & 1) k >>= 1;
+    return k >> 1;
+}
+
+int findIndexByRollSorted(int roll) {
+    if (sortedRollStale && !indexBuildBusy()) rebuildSortedRolls();
+    if (sortedRollStale) return -2;                         // still building, or no memory: caller scans
+    int k = rollLowerBound(roll);
+    return k && rollTree[k].roll == roll ? rollTree[k].idx : -1;
+}
+
+/*
+   Calls fn(idx, ctx) for each record with lo <= roll <= hi, in roll
+   order, until fn returns nonzero. Returns the number of records visited,
+   or -1 if out of memory. While a background build is running, the
+   matching records are found by a scan and sorted instead.
+*/
+int scanRollRange(int lo, int hi, int (*fn)(int idx, void *ctx), void *ctx) {
+    if (sortedRollStale && !indexBuildBusy()) rebuildSortedRolls();
+    int n = 0;
+    if (sortedRollStale) {
+        RollSlot *hits = arenaAlloc(threadArena(), sizeof(RollSlot) * (size_t)(studentCount ? studentCount : 1));
+        if (!hits) return -1;
+        int m = 0;
+        for (int i = 0; i < studentCount; ++i)
+            if (students[i].roll >= lo && students[i].roll <= hi) { hits[m].roll = students[i].roll; hits[m++].idx = i; }
+        qsort(hits, m, sizeof(RollSlot), cmpRollSlot);
+        for (int k = 0; k < m; ++k) {
+            n++;
+            if (fn(hits[k].idx, ctx)) break;
+        }
+        return n;
+    }
+    for (int k = rollLowerBound(lo); k && rollTree[k].roll <= hi; k = rollTreeNext(k)) {
+        n++;
+        if (fn(rollTree[k].idx, ctx)) break;
+    }
+    return n;
+}
+
+/* --------------- Concurrent Roll Map --------------- */
+/*
+   roll -> record map that many threads may read and write at once, for
+   embedding the roster in a server or library. The command loop is
+   single-threaded and keeps the open-addressing index above.
+
+   - lookups take no lock: they walk one bucket's chain, whose nodes are
+     published with release stores
+   - writers lock one of CMAP_STRIPES stripes picked by the roll's hash,
+     so writers of different stripes never wait on each other; changing
+     the record of a roll already present is one atomic store
+   - growing takes every stripe, copies the chains into a table twice the
+     size and publishes it; lookups still walking the old table finish
+     there undisturbed
+   - unlinked nodes and replaced tables are freed by epoch-based
+     reclamation (below), never while a lookup may still hold them
+*/
+
+#ifndef _WIN32
+/*
+   Epochs: a thread inside a lock-free section announces the global
+   epoch it saw on entry (0 when outside). The epoch only advances once
+   every thread inside has seen the current one, so memory retired in
+   epoch E is unreachable by anyone once the epoch reaches E + 2.
+   Threads claim an announcement slot on first use and give it back when
+   they exit; beyond EPOCH_THREADS live threads, entering waits for one.
+*/
+
+#define EPOCH_THREADS 128
+
+typedef struct {
+    _Alignas(64) _Atomic uint64_t epoch;    // one cache line per thread
+    atomic_int used;
+} EpochSlot;
+
+typedef struct { void *ptr; uint64_t epoch; } Retired;
+
+static EpochSlot epochSlots[EPOCH_THREADS];
+static _Atomic uint64_t globalEpoch = 1;
+static _Thread_local int epochSlot = -1;
+static pthread_key_t epochKey;
+static pthread_once_t epochKeyOnce = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t retiredLock = PTHREAD_MUTEX_INITIALIZER;   // guards the list below
+static Retired *retired = NULL;
+static int retiredCount = 0, retiredCap = 0, retiredCollectAt = 256;
+
+static void releaseEpochSlot(void *slot) {
+    atomic_store(&epochSlots[(intptr_t)slot - 1].used, 0);
+}
+
+static void makeEpochKey() {
+    pthread_key_create(&epochKey, releaseEpochSlot);
+}
+
+static int claimEpochSlot() {
+    pthread_once(&epochKeyOnce, makeEpochKey);
+    for (;;) {
+        for (int i = 0; i < EPOCH_THREADS; ++i) {
+            int unused = 0;
+            if (atomic_compare_exchange_strong(&epochSlots[i].used, &unused, 1)) {
+                pthread_setspecific(epochKey, (void *)(intptr_t)(i + 1));
+                return i;
+            }
+        }
+        sched_yield();
+    }
+}
+
+static void epochEnter() {
+    if (epochSlot < 0) epochSlot = claimEpochSlot();
+    atomic_store(&epochSlots[epochSlot].epoch, atomic_load(&globalEpoch));   // seq_cst: visible before any read inside
+}
+
+static void epochExit() {
+    atomic_store_explicit(&epochSlots[epochSlot].epoch, 0, memory_order_release);
+}
+
+// Frees what no thread can reach any more. Caller holds retiredLock.
+static void epochCollect() {
+    uint64_t e = atomic_load(&globalEpoch);
+    int behind = 0;
+    for (int i = 0; i < EPOCH_THREADS && !behind; ++i) {
+        uint64_t seen = atomic_load(&epochSlots[i].epoch);
+        behind = seen && seen != e;
+    }
+    if (!behind && atomic_compare_exchange_strong(&globalEpoch, &e, e + 1)) e++;
+    int kept = 0;
+    for (int i = 0; i < retiredCount; ++i) {
+        if (retired[i].epoch + 2 <= e) free(retired[i].ptr);
+        else retired[kept++] = retired[i];
+    }
+    retiredCount = kept;
+    retiredCollectAt = kept * 2 > 256 ? kept * 2 : 256;    // a stalled reader must not make this quadratic
+}
+
+// epochRetire() with retiredLock held.
+static void retireLocked(void *ptr) {
+    if (retiredCount == retiredCap) {
+        int cap = retiredCap ? retiredCap * 2 : 1024;
+        Retired *grown = realloc(retired, sizeof(Retired) * (size_t)cap);
+        if (!grown) return;                                 // leaked rather than freed too early
+        retired = grown;
+        retiredCap = cap;
+    }
+    retired[retiredCount].ptr = ptr;
+    retired[retiredCount++].epoch = atomic_load(&globalEpoch);
+    if (retiredCount >= retiredCollectAt) epochCollect();
+}
+
+// Frees ptr (from malloc) once no lock-free section can still see it.
+static void epochRetire(void *ptr) {
+    pthread_mutex_lock(&retiredLock);
+    retireLocked(ptr);
+    pthread_mutex_unlock(&retiredLock);
+}
+
+#define CMAP_STRIPES 64                 // also the smallest table: a bucket's chain belongs to one stripe
+
+typedef struct CmapNode {
+    int roll;
+    atomic_int idx;
+    _Atomic(struct CmapNode *) next;
+} CmapNode;
+
+typedef struct {
+    unsigned mask;
+    _Atomic(CmapNode *) heads[];
+} CmapTable;
+
+typedef struct { _Alignas(64) pthread_mutex_t lock; } CmapStripe;
+
+typedef struct {
+    _Atomic(CmapTable *) table;
+    atomic_int count;
+    CmapStripe stripes[CMAP_STRIPES];
+} RollMap;
+
+// Frees a table and its nodes; no lookup may still be walking it.
+static void freeCmapTable(CmapTable *t) {
+    for (unsigned b = 0; b <= t->mask; ++b)
+        for (CmapNode *n = atomic_load(&t->heads[b]), *next; n; n = next) {
+            next = atomic_load(&n->next);
+            free(n);
+        }
+    free(t);
+}
+
+static CmapTable *newCmapTable(unsigned cap) {
+    CmapTable *t = malloc(sizeof(CmapTable) + sizeof(t->heads[0]) * cap);
+    if (!t) return NULL;
+    t->mask = cap - 1;
+    for (unsigned i = 0; i < cap; ++i) atomic_init(&t->heads[i], NULL);
+    return t;
+}
+
+// Room for `capacity` entries before the first grow. NULL if out of memory.
+RollMap *rollMapCreate(int capacity) {
+    unsigned cap = CMAP_STRIPES;
+    while (cap < (unsigned)capacity) cap <<= 1;
+    RollMap *m = malloc(sizeof(RollMap));
+    CmapTable *t = newCmapTable(cap);
+    if (!m || !t) { free(m); free(t); return NULL; }
+    atomic_init(&m->table, t);
+    atomic_init(&m->count, 0);
+    for (int i = 0; i < CMAP_STRIPES; ++i) pthread_mutex_init(&m->stripes[i].lock, NULL);
+    return m;
+}
+
+// No other thread may be using m.
+void rollMapFree(RollMap *m) {
+    freeCmapTable(atomic_load(&m->table));
+    for (int i = 0; i < CMAP_STRIPES; ++i) pthread_mutex_destroy(&m->stripes[i].lock);
+    free(m);
+}
+
+static CmapStripe *cmapStripe(RollMap *m, unsigned h) {
+    return &m->stripes[h % CMAP_STRIPES];
+}
+
+// Record of roll, or -1. Never blocks.
+int rollMapGet(RollMap *m, int roll) {
+    unsigned h = hashRoll(roll);
+    int idx = -1;
+    epochEnter();
+    CmapTable *t = atomic_load_explicit(&m->table, memory_order_acquire);
+    for (CmapNode *n = atomic_load_explicit(&t->heads[h & t->mask], memory_order_acquire); n;
+         n = atomic_load_explicit(&n->next, memory_order_acquire))
+        if (n->roll == roll) { idx = atomic_load_explicit(&n->idx, memory_order_acquire); break; }
+    epochExit();
+    return idx;
+}
+
+// Doubles the table unless another writer already grew it past `seenMask`.
+static void rollMapGrow(RollMap *m, unsigned seenMask) {
+    for (int i = 0; i < CMAP_STRIPES; ++i) pthread_mutex_lock(&m->stripes[i].lock);
+    CmapTable *old = atomic_load(&m->table);
+    CmapTable *t = old->mask == seenMask ? newCmapTable((old->mask + 1) * 2) : NULL;
+    int ok = t != NULL;
+    for (unsigned b = 0; ok && b <= old->mask; ++b)
+        for (CmapNode *n = atomic_load(&old->heads[b]); ok && n; n = atomic_load(&n->next)) {
+            CmapNode *copy = malloc(sizeof(CmapNode));
+            if (!(ok = copy != NULL)) break;
+            _Atomic(CmapNode *) *head = &t->heads[hashRoll(n->roll) & t->mask];
+            copy->roll = n->roll;
+            atomic_init(&copy->idx, atomic_load(&n->idx));
+            atomic_init(&copy->next, atomic_load(head));
+            atomic_init(head, copy);
+        }
+    if (ok) atomic_store_explicit(&m->table, t, memory_order_release);
+    else if (t) freeCmapTable(t);                           // out of memory: keep the old table
+    for (int i = CMAP_STRIPES - 1; i >= 0; --i) pthread_mutex_unlock(&m->stripes[i].lock);
+    if (!ok) return;
+    pthread_mutex_lock(&retiredLock);                       // writers only reach the new table now
+    for (unsigned b = 0; b <= old->mask; ++b)
+        for (CmapNode *n = atomic_load(&old->heads[b]); n; n = atomic_load(&n->next)) retireLocked(n);
+    retireLocked(old);
+    pthread_mutex_unlock(&retiredLock);
+}
+
+// Maps roll to idx, replacing any earlier record. 0 if out of memory.
+int rollMapPut(RollMap *m, int roll, int idx) {
+    unsigned h = hashRoll(roll);
+    CmapStripe *s = cmapStripe(m, h);
+    pthread_mutex_lock(&s->lock);
+    CmapTable *t = atomic_load_explicit(&m->table, memory_order_relaxed);   // stable while we hold a stripe
+    _Atomic(CmapNode *) *head = &t->heads[h & t->mask];
+    for (CmapNode *n = atomic_load_explicit(head, memory_order_relaxed); n;
+         n = atomic_load_explicit(&n->next, memory_order_relaxed))
+        if (n->roll == roll) {
+            atomic_store_explicit(&n->idx, idx, memory_order_release);
+            pthread_mutex_unlock(&s->lock);
+            return 1;
+        }
+    CmapNode *n = malloc(sizeof(CmapNode));
+    if (!n) { pthread_mutex_unlock(&s->lock); return 0; }
+    n->roll = roll;
+    atomic_init(&n->idx, idx);
+    atomic_init(&n->next, atomic_load_explicit(head, memory_order_relaxed));
+    atomic_store_explicit(head, n, memory_order_release);  // lookups see the node only once it is filled in
+    int count = atomic_fetch_add(&m->count, 1) + 1;
+    unsigned mask = t->mask;                                // t may be retired once the stripe is released
+    pthread_mutex_unlock(&s->lock);
+    if ((unsigned)count > mask + 1) rollMapGrow(m, mask);   // load factor <= 1
+    return 1;
+}
+
+// Removes roll; returns its record, or -1 if it was absent.
+int rollMapRemove(RollMap *m, int roll) {
+    unsigned h = hashRoll(roll);
+    CmapStripe *s = cmapStripe(m, h);
+    pthread_mutex_lock(&s->lock);
+    CmapTable *t = atomic_load_explicit(&m->table, memory_order_relaxed);
+    _Atomic(CmapNode *) *link = &t->heads[h & t->mask];
+    for (CmapNode *n; (n = atomic_load_explicit(link, memory_order_relaxed)); link = &n->next)
+        if (n->roll == roll) {
+            int idx = atomic_load_explicit(&n->idx, memory_order_relaxed);
+            atomic_store_explicit(link, atomic_load_explicit(&n->next, memory_order_relaxed), memory_order_release);
+            atomic_fetch_sub(&m->count, 1);
+            pthread_mutex_unlock(&s->lock);
+            epochRetire(n);                                 // a lookup may still be standing on it
+            return idx;
+        }
+    pthread_mutex_unlock(&s->lock);
+    return -1;
+}
+
+int rollMapCount(RollMap *m) {
+    return atomic_load(&m->count);
+}
+#endif
+
+/* -------------------- Name Index ------------------- */
+/*
+   Backs the tiered search (find): exact -> prefix -> substring -> fuzzy.
+
+   - exact:     hash of the folded full name -> students (open addressing)
+   - prefix:    every word start of every folded name, sorted, so a
+                binary search finds names where any word starts with the query
+   - substring: the parallel name scan with a limit
+   - fuzzy:     bounded edit distance of the query against each word
+
+   Built lazily like the roll index: any name or roster change marks it
+   stale and the next search rebuilds it.
+*/
+
+typedef struct { unsigned hash; int idx; } NameSlot;      // idx < 0: empty
+typedef struct { int idx; unsigned char off; } WordRef;   // word at students[idx].folded + off
+
+static NameSlot *nameSlots = NULL;
+static unsigned nameMask = 0;
+static WordRef *words = NULL;
+static int wordCount = 0;
+
+static unsigned hashName(const char *s) {
+    unsigned h = 2166136261u;                               // FNV-1a
+    while (*s) { h ^= (unsigned char)*s++; h *= 16777619u; }
+    return h;
+}
+
+static const char *wordText(const WordRef *w) {
+    return students[w->idx].folded + w->off;
+}
+
+typedef struct {
+    NameSlot *slots;
+    unsigned mask;
+    WordRef *words;
+    int wordCount;
+} NameIndex;
+
+typedef struct { NameSlot *slots; unsigned mask; } NameTable;
+
+static void nameSlotKey(BulkItem *it, int idx, const void *ctx) {
+    (void)ctx;
+    it->key = hashName(students[idx].folded);
+}
+
+static int namePlace(void *table, const BulkItem *it, unsigned limit) {
+    NameTable *t = table;
+    for (unsigned i = (unsigned)it->key & t->mask;;) {
+        if (t->slots[i].idx < 0) {
+            t->slots[i].hash = (unsigned)it->key;
+            t->slots[i].idx = it->idx;
+            return 1;
+        }
+        if (++i == limit) return 0;
+        i &= t->mask;
+    }
+}
+
+static int isWordStart(const char *f, int k) {
+    return f[k] != ' ' && (k == 0 || f[k - 1] == ' ');
+}
+
+// First eight bytes of a word, big-endian and zero padded: compares like strcmp.
+static uint64_t wordPrefix(const char *w) {
+    uint64_t key = 0;
+    int k = 0;
+    for (; k < 8 && w[k]; ++k) key = key << 8 | (unsigned char)w[k];
+    return k ? key << (8 * (8 - k)) : 0;
+}
+
+/*
+   Words sort by their text (from the word start to the end of the name),
+   then by record. MSD radix sort of a run of words, one byte of text per
+   level. Eight bytes are cached in key at a time; a level where every
+   word has the same byte costs one counting pass and no moves, and short
+   runs are insertion sorted on the cached bytes. Stable, so equal texts
+   stay in the order they were gathered (record order).
+*/
+static void sortWordRun(BulkItem *items, BulkItem *tmp, int n, int depth) {
+    while (n >= 32) {
+        if (depth % 8 == 0)
+            for (int k = 0; k < n; ++k) items[k].key = wordPrefix(students[items[k].idx].folded + items[k].aux + depth);
+        int shift = 8 * (7 - depth % 8), count[256] = {0};
+        for (int k = 0; k < n; ++k) count[(items[k].key >> shift) & 0xFF]++;
+        int only = (int)((items[0].key >> shift) & 0xFF);
+        if (count[only] == n) {
+            if (!only) return;                              // every text ends here: all equal
+            depth++;
+            continue;
+        }
+        int start[257], next[256];
+        start[0] = 0;
+        for (int b = 0; b < 256; ++b) start[b + 1] = start[b] + count[b];
+        memcpy(next, start, sizeof(next));
+        for (int k = 0; k < n; ++k) tmp[next[(items[k].key >> shift) & 0xFF]++] = items[k];
+        memcpy(items, tmp, sizeof(BulkItem) * (size_t)n);
+        for (int b = 1; b < 256; ++b)                       // bucket 0: texts that ended, all equal
+            sortWordRun(items + start[b], tmp + start[b], start[b + 1] - start[b], depth + 1);
+        return;
+    }
+    int window = depth ? (depth - 1) & ~7 : 0;              // the window the cached bytes came from
+    for (int k = 1; k < n; ++k) {
+        BulkItem it = items[k];
+        int j = k;
+        for (; j > 0; --j) {
+            const BulkItem *p = &items[j - 1];
+            if (p->key < it.key) break;
+            if (p->key == it.key && (!(it.key & 0xFF) ||
+                strcmp(students[p->idx].folded + p->aux + window + 8, students[it.idx].folded + it.aux + window + 8) <= 0)) break;
+            items[j] = *p;
+        }
+        items[j] = it;
+    }
+}
+
+typedef struct { BulkItem *items, *tmp; const int *start; } WordSort;
+
+static void wordPrefixRange(void *ctx, int begin, int end) {
+    WordSort *s = ctx;
+    for (int k = begin; k < end; ++k) s->items[k].key = wordPrefix(students[s->items[k].idx].folded + s->items[k].aux);
+}
+
+static void sortWordBuckets(void *ctx, int begin, int end) {
+    WordSort *s = ctx;
+    for (int b = begin; b < end; ++b)
+        sortWordRun(s->items + s->start[b], s->tmp + s->start[b], s->start[b + 1] - s->start[b], 1);
+}
+
+// Sorts gathered words: partitioned on the first byte, then each bucket in parallel.
+static int sortWords(BulkItem *items, int n) {
+    BulkItem *tmp = malloc(sizeof(BulkItem) * (size_t)(n ? n : 1));
+    int start[257];
+    WordSort s = { items, tmp, start };
+    if (!tmp) return 0;
+    parallelFor(n, 4096, wordPrefixRange, &s);
+    int ok = bulkPartition(items, tmp, n, 56, 256, start);
+    if (ok) {
+        memcpy(items, tmp, sizeof(BulkItem) * (size_t)n);
+        parallelFor(256, 1, sortWordBuckets, &s);
+    }
+    free(tmp);
+    return ok;
+}
+
+typedef struct {
+    int n, parts;
+    int *first;         // first[p]: part p's first word (after the counting pass: word count of part p - 1)
+    BulkItem *items;
+} WordGather;
+
+static void countWords(void *ctx, int begin, int end) {
+    WordGather *g = ctx;
+    for (int p = begin; p < end; ++p) {
+        int count = 0, to = (int)((long)g->n * (p + 1) / g->parts);
+        for (int i = (int)((long)g->n * p / g->parts); i < to; ++i)
+            for (int k = 0; students[i].folded[k]; ++k) count += isWordStart(students[i].folded, k);
+        g->first[p + 1] = count;
+    }
+}
+
+static void gatherWords(void *ctx, int begin, int end) {
+    WordGather *g = ctx;
+    for (int p = begin; p < end; ++p) {
+        BulkItem *w = g->items + g->first[p];
+        int to = (int)((long)g->n * (p + 1) / g->parts);
+        for (int i = (int)((long)g->n * p / g->parts); i < to; ++i) {
+            const char *f = students[i].folded;
+            for (int k = 0; f[k]; ++k)
+                if (isWordStart(f, k)) { w->idx = i; w->aux = k; w++; }
+        }
+    }
+}
+
+// Index over students[0, n), whose names must be materialized; touches no globals.
+static int buildNameIndex(int n, NameIndex *ix) {
+    unsigned cap = 16;
+    while (cap < (unsigned)n * 2) cap <<= 1;
+    WordGather g = { n, bulkParts(n), calloc((size_t)bulkParts(n) + 1, sizeof(int)), NULL };
+    if (!g.first) return 0;
+    parallelFor(g.parts, 1, countWords, &g);
+    for (int p = 0; p < g.parts; ++p) g.first[p + 1] += g.first[p];
+    int nw = g.first[g.parts];
+
+    NameSlot *slots = malloc(sizeof(NameSlot) * cap);
+    WordRef *w = malloc(sizeof(WordRef) * (nw ? nw : 1));
+    BulkItem *keys = bulkGather(n, nameSlotKey, NULL);
+    g.items = malloc(sizeof(BulkItem) * (nw ? nw : 1));
+    int ok = slots && w && keys && g.items;
+    if (ok) {
+        for (unsigned i = 0; i < cap; ++i) slots[i].idx = -1;
+        NameTable t = { slots, cap - 1 };
+        parallelFor(g.parts, 1, gatherWords, &g);
+        ok = bulkFill(keys, n, cap, 0, namePlace, &t) && sortWords(g.items, nw);
+    }
+    for (int k = 0; ok && k < nw; ++k) {
+        w[k].idx = g.items[k].idx;
+        w[k].off = (unsigned char)g.items[k].aux;
+    }
+    free(keys);
+    free(g.items);
+    free(g.first);
+    if (!ok) { free(slots); free(w); return 0; }
+    ix->slots = slots;
+    ix->mask = cap - 1;
+    ix->words = w;
+    ix->wordCount = nw;
+    return 1;
+}
+
+static void installNameIndex(const NameIndex *ix) {
+    NameSlot *oldSlots = nameSlots;
+    WordRef *oldWords = words;
+    nameSlots = ix->slots; nameMask = ix->mask;
+    words = ix->words; wordCount = ix->wordCount;
+    nameIndexStale = 0;
+    if (!indexMapped(oldSlots)) free(oldSlots);
+    if (!indexMapped(oldWords)) free(oldWords);
+    releaseIndexMap();
+}
+
+static void rebuildNameIndex() {
+    materializeNames();
+    double t0 = spanStart();
+    NameIndex ix;
+    if (!buildNameIndex(studentCount, &ix)) return;
+    installNameIndex(&ix);
+    noteIndexBuild("name", studentCount, t0);
+}
+
+// Decodes s into at most cap code points, or returns -1 if it has more.
+static int toCodePoints(const char *s, unsigned *out, int cap) {
+    int n = 0;
+    for (const unsigned char *p = (const unsigned char *)s; *p; ++n) {
+        if (n == cap) return -1;
+        int len = utf8Decode(p, &out[n]);
+        if (out[n] == 0xFFFFFFFFu) out[n] = 0xDC00u | *p;   // keep stray bytes distinct
+        p += len;
+    }
+    return n;
+}
+
+// Edit distance in code points between a and b, or max + 1 once it must exceed max.
+static int boundedDistance(const char *a, const char *b, int max) {
+    unsigned ca[MAX_NAME], cb[MAX_NAME];
+    int la = toCodePoints(a, ca, MAX_NAME - 1), lb = toCodePoints(b, cb, MAX_NAME - 1);
+    if (la < 0 || lb < 0 || la - lb > max || lb - la > max) return max + 1;
+    int row[MAX_NAME];
+    for (int j = 0; j <= lb; ++j) row[j] = j;
+    for (int i = 1; i <= la; ++i) {
+        int diag = row[0], best = row[0] = i;
+        for (int j = 1; j <= lb; ++j) {
+            int up = row[j];
+            int v = diag + (ca[i - 1] != cb[j - 1]);
+            if (up + 1 < v) v = up + 1;
+            if (row[j - 1] + 1 < v) v = row[j - 1] + 1;
+            row[j] = v;
+            diag = up;
+            if (v < best) best = v;
+        }
+        if (best > max) return max + 1;
+    }
+    return row[lb];
+}
+
+typedef struct {
+    int idx;
+    int tier;       // 0 exact, 1 prefix, 2 substring, 3 fuzzy
+    int score;      // lower is better within a tier
+} SearchHit;
+
+static const char *tierNames[] = { "exact", "prefix", "substring", "fuzzy" };
+
+// Record indexes already in the hits, so a later tier does not add them again.
+typedef struct {
+    int *slots;                     // open addressing, -1 empty; NULL: compare against every hit
+    unsigned mask;
+} HitSeen;
+
+static HitSeen hitSeenCreate(int limit) {
+    unsigned cap = 16, most = (unsigned)(limit < studentCount ? limit : studentCount);
+    while (cap < most * 2) cap <<= 1;
+    HitSeen seen = { arenaAlloc(threadArena(), sizeof(int) * cap), cap - 1 };
+    if (seen.slots) memset(seen.slots, 0xff, sizeof(int) * cap);
+    return seen;
+}
+
+static int addHit(SearchHit *hits, int n, HitSeen *seen, int idx, int tier, int score) {
+    if (!seen->slots) {
+        for (int k = 0; k < n; ++k) if (hits[k].idx == idx) return n;
+    } else {
+        unsigned k = hashRoll(idx) & seen->mask;
+        for (; seen->slots[k] >= 0; k = (k + 1) & seen->mask)
+            if (seen->slots[k] == idx) return n;
+        seen->slots[k] = idx;
+    }
+    hits[n].idx = idx; hits[n].tier = tier; hits[n].score = score;
+    return n + 1;
+}
+
+static int cmpSearchHit(const void *a, const void *b) {
+    const SearchHit *x = (const SearchHit *)a, *y = (const SearchHit *)b;
+    if (x->tier != y->tier) return x->tier - y->tier;
+    if (x->score != y->score) return x->score - y->score;
+    return students[x->idx].roll - students[y->idx].roll;
+}
+
+#define FUZZY_KEEP 64
+
+typedef struct {
+    const char *q;
+    int maxDist;
+    SearchHit *best[MAX_WORKERS];   // per-worker candidates, from that worker's arena
+    int count[MAX_WORKERS];
+} FuzzyScan;
+
+static void fuzzyWorker(void *ctx, int begin, int end) {
+    FuzzyScan *f = (FuzzyScan *)ctx;
+    SearchHit *top = arenaAlloc(threadArena(), sizeof(SearchHit) * FUZZY_KEEP);
+    int nf = 0;
+    if (!top) return;
+    for (int i = begin; i < end; ++i) {
+        const char *name = students[i].folded;
+        int best = boundedDistance(f->q, name, f->maxDist);
+        char word[MAX_NAME];
+        for (const char *p = name; *p && best > 0; ) {
+            size_t wl = strcspn(p, " ");
+            memcpy(word, p, wl); word[wl] = '\0';
+            int d = boundedDistance(f->q, word, f->maxDist);
+            if (d < best) best = d;
+            p += wl;
+            while (*p == ' ') p++;
+        }
+        if (best > f->maxDist) continue;
+        // keep this worker's best candidates
+        if (nf < FUZZY_KEEP) { top[nf].idx = i; top[nf].tier = 3; top[nf++].score = best; }
+        else {
+            int worst = 0;
+            for (int k = 1; k < nf; ++k) if (top[k].score > top[worst].score) worst = k;
+            if (best < top[worst].score) { top[worst].idx = i; top[worst].score = best; }
+        }
+    }
+    f->best[workerSlot] = top;
+    f->count[workerSlot] = nf;
+}
+
+/*
+   Records whose folded name equals the folded query, in roster order.
+   Misses are usually settled by the name Bloom filter alone.
+*/
+int findByExactName(const char *name, int *out, int limit) {
+    char q[MAX_NAME * 2];
+    foldName(name, q, sizeof(q));
+    if (!q[0] || !nameMayExist(q)) return 0;
+    int n = 0;
+    for (int i = 0; i < studentCount && (limit <= 0 || n < limit); ++i)
+        if (strcmp(students[i].folded, q) == 0) out[n++] = i;
+    return n;
+}
+
+// The exact and prefix tiers by scan, while the name index is still being built.
+static int scanExactPrefix(const char *q, size_t qlen, int limit, SearchHit *hits, HitSeen *seen) {
+    int n = 0;
+    for (int i = 0; i < studentCount && n < limit; ++i)
+        if (strcmp(students[i].folded, q) == 0) n = addHit(hits, n, seen, i, 0, 0);
+    for (int i = 0; i < studentCount && n < limit; ++i) {
+        const char *f = students[i].folded;
+        int off = -1;
+        for (int j = 0; f[j] && off < 0; ++j)
+            if (f[j] != ' ' && (j == 0 || f[j - 1] == ' ') && strncmp(f + j, q, qlen) == 0) off = j;
+        if (off >= 0) n = addHit(hits, n, seen, i, 1, (off ? 1000 : 0) + (int)strlen(f));
+    }
+    return n;
+}
+
+/*
+   Tiered search for up to limit results, ranked by tier and then by a
+   per-tier score. Later tiers run only while fewer than limit results
+   exist. Returns the number of hits written to hits (room for limit).
+*/
+int smartSearch(const char *query, int limit, SearchHit *hits) {
+    char q[MAX_NAME * 2];
+    foldName(query, q, sizeof(q));
+    size_t qlen = strlen(q);
+    if (!qlen || limit < 1) return 0;
+    materializeNames();                                     // an index read from FILE.idx may precede them
+    int building = nameIndexStale && indexBuildBusy();
+    if (nameIndexStale && !building) {
+        rebuildNameIndex();
+        if (nameIndexStale) return 0;
+    }
+    int n = 0;
+    HitSeen seen = hitSeenCreate(limit);
+
+    if (building) n = scanExactPrefix(q, qlen, limit, hits, &seen);
+    else {
+        // exact: full folded name
+        unsigned h = hashName(q);
+        for (unsigned k = h & nameMask; nameSlots[k].idx >= 0 && n < limit; k = (k + 1) & nameMask)
+            if (nameSlots[k].hash == h && strcmp(students[nameSlots[k].idx].folded, q) == 0)
+                n = addHit(hits, n, &seen, nameSlots[k].idx, 0, 0);
+
+        // prefix: any word of the name starts with the query; whole-name prefixes first
+        if (n < limit) {
+            int lo = 0, hi = wordCount;
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (strcmp(wordText(&words[mid]), q) < 0) lo = mid + 1; else hi = mid;
+            }
+            for (int k = lo; k < wordCount && n < limit && strncmp(wordText(&words[k]), q, qlen) == 0; ++k) {
+                const Student *s = &students[words[k].idx];
+                n = addHit(hits, n, &seen, words[k].idx, 1, (words[k].off ? 1000 : 0) + (int)strlen(s->folded));
+            }
+        }
+    }
+
+    // substring: parallel scan kernel, stopping at what is still needed
+    if (n < limit && !strpbrk(q, "*?")) {
+        int *idx = arenaAlloc(threadArena(), sizeof(int) * (studentCount ? studentCount : 1));
+        if (idx) {
+            int found = scanNames(query, limit, idx);
+            for (int k = 0; k < found && n < limit; ++k)
+                n = addHit(hits, n, &seen, idx[k], 2, (int)(strstr(students[idx[k]].folded, q) - students[idx[k]].folded));
+        }
+    }
+
+    // fuzzy: typo tolerance against each word and the full name
+    int chars = 0;
+    for (size_t k = 0; k < qlen; ++k) chars += (q[k] & 0xC0) != 0x80;
+    if (n < limit && chars >= 3) {
+        FuzzyScan f = { q, chars >= 6 ? 2 : 1, {0}, {0} };
+        parallelFor(studentCount, 4096, fuzzyWorker, &f);
+        int total = 0;
+        for (int w = 0; w < MAX_WORKERS; ++w) total += f.count[w];
+        SearchHit *all = arenaAlloc(threadArena(), sizeof(SearchHit) * (total ? total : 1));
+        if (all) {
+            total = 0;
+            for (int w = 0; w < MAX_WORKERS; ++w)
+                if (f.count[w]) { memcpy(all + total, f.best[w], sizeof(SearchHit) * f.count[w]); total += f.count[w]; }
+            qsort(all, total, sizeof(SearchHit), cmpSearchHit);
+            for (int k = 0; k < total && n < limit; ++k) n = addHit(hits, n, &seen, all[k].idx, 3, all[k].score);
+        }
+    }
+
+    qsort(hits, n, sizeof(SearchHit), cmpSearchHit);
+    return n;
+}
+
+/* -------------------- Zone Maps -------------------- */
+/*
+   A summary per block of ZONE_BLOCK consecutive records: the smallest
+   and largest roll, average and subject count in it. A filtered scan
+   (list and join --where) asks each block's zone whether any of its
+   records could pass before reading them, and skips the block when none
+   can. Sorting the roster by the filtered field makes the zones
+   tightest, but even unsorted rolls tend to rise through the file.
+
+   Rebuilt lazily like the indexes and saved in FILE.idx. An append
+   widens the last zone; an edit through commitStudent() only marks its
+   zone dirty, and the next scan re-summarizes the zone before using it.
+*/
+
+#define ZONE_BLOCK 1024
+
+enum { ZONE_ROLL, ZONE_AVERAGE, ZONE_SUBJECTS };
+
+typedef struct {
+    int rollMin, rollMax;
+    int subjMin, subjMax;
+    double avgMin, avgMax;          // as filters see them: rounded to two decimals
+    _Atomic int dirty;              // edited since summarized
+} Zone;
+
+static Zone *zones = NULL;
+static int zoneCount = 0, zoneCap = 0;
+
+// The average as printed, which is what filters compare against.
+static double shownAverage(float avg) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.2f", avg);
+    return strtod(buf, NULL);
+}
+
+static void widenZone(Zone *z, const Student *s) {
+    double avg = shownAverage(s->average);
+    if (s->roll < z->rollMin) z->rollMin = s->roll;
+    if (s->roll > z->rollMax) z->rollMax = s->roll;
+    if (s->subjectCount < z->subjMin) z->subjMin = s->subjectCount;
+    if (s->subjectCount > z->subjMax) z->subjMax = s->subjectCount;
+    if (avg < z->avgMin) z->avgMin = avg;
+    if (avg > z->avgMax) z->avgMax = avg;
+}
+
+// Summarizes block b of students[0, n).
+static void summarizeZone(Zone *z, int b, int n) {
+    int begin = b * ZONE_BLOCK, end = n - begin < ZONE_BLOCK ? n : begin + ZONE_BLOCK;
+    const Student *s = &students[begin];
+    float avgMin = s->average, avgMax = s->average;
+    z->rollMin = z->rollMax = s->roll;
+    z->subjMin = z->subjMax = s->subjectCount;
+    for (int i = begin + 1; i < end; ++i) {
+        s = &students[i];
+        if (s->roll < z->rollMin) z->rollMin = s->roll;
+        if (s->roll > z->rollMax) z->rollMax = s->roll;
+        if (s->subjectCount < z->subjMin) z->subjMin = s->subjectCount;
+        if (s->subjectCount > z->subjMax) z->subjMax = s->subjectCount;
+        if (s->average < avgMin) avgMin = s->average;
+        if (s->average > avgMax) avgMax = s->average;
+    }
+    z->avgMin = shownAverage(avgMin);               // rounding keeps the order, so only the ends need it
+    z->avgMax = shownAverage(avgMax);
+    atomic_store_explicit(&z->dirty, 0, memory_order_relaxed);
+}
+
+typedef struct { Zone *zones; int n; } ZoneJob;
+
+static void summarizeZones(void *ctx, int begin, int end) {
+    const ZoneJob *j = ctx;
+    for (int b = begin; b < end; ++b) summarizeZone(&j->zones[b], b, j->n);
+}
+
+// Zones for students[0, n). Reads only the records, so the background builder can call it.
+static Zone *buildZones(int n, int *count, int *cap) {
+    *count = (n + ZONE_BLOCK - 1) / ZONE_BLOCK;
+    *cap = *count + *count / 8 + 4;                 // room for appends
+    Zone *z = malloc(sizeof(Zone) * (size_t)*cap);
+    if (!z) return NULL;
+    ZoneJob j = { z, n };
+    parallelFor(*count, 64, summarizeZones, &j);
+    return z;
+}
+
+static void installZones(Zone *z, int count, int cap) {
+    Zone *old = zones;
+    zones = z; zoneCount = count; zoneCap = cap;
+    zoneMapStale = 0;
+    if (!indexMapped(old)) free(old);
+    releaseIndexMap();
+}
+
+static void rebuildZones() {
+    double t0 = spanStart();
+    int count, cap;
+    Zone *z = buildZones(studentCount, &count, &cap);
+    if (!z) return;                                 // scans read every block instead
+    installZones(z, count, cap);
+    noteIndexBuild("zones", count, t0);
+}
+
+// Nonzero when zones are usable, rebuilding them first if needed.
+int ensureZones() {
+    if (zoneMapStale && !indexBuildBusy()) rebuildZones();
+    return !zoneMapStale;
+}
+
+// Call after appending students[idx].
+void zoneAppended(int idx) {
+    if (zoneMapStale) return;
+    int b = idx / ZONE_BLOCK;
+    if (b >= zoneCap) { zoneMapStale = 1; return; }
+    if (b == zoneCount) summarizeZone(&zones[zoneCount++], b, idx + 1);
+    else widenZone(&zones[b], &students[idx]);
+}
+
+void zoneTouched(int idx) {
+    if (!zoneMapStale && idx / ZONE_BLOCK < zoneCount)
+        atomic_store_explicit(&zones[idx / ZONE_BLOCK].dirty, 1, memory_order_relaxed);
+}
+
+/*
+   Zone of block b, re-summarized first if an edit marked it; NULL when
+   there are no usable zones. Each block must be asked for by one thread
+   at a time.
+*/
+const Zone *blockZone(int b) {
+    if (zoneMapStale || b >= zoneCount) return NULL;
+    Zone *z = &zones[b];
+    if (atomic_exchange_explicit(&z->dirty, 0, memory_order_relaxed)) summarizeZone(z, b, studentCount);
+    return z;
+}
+
+// Re-summarizes every zone an edit marked, so they can be saved.
+static void refreshZones() {
+    for (int b = 0; b < zoneCount; ++b) blockZone(b);
+}
+
+// Whether some record in z could satisfy "field op v" (ops as in the join filters).
+int zoneMayMatch(const Zone *z, int field, char op, double v) {
+    double lo = field == ZONE_ROLL ? z->rollMin : field == ZONE_SUBJECTS ? z->subjMin : z->avgMin;
+    double hi = field == ZONE_ROLL ? z->rollMax : field == ZONE_SUBJECTS ? z->subjMax : z->avgMax;
+    switch (op) {
+        case '=': return lo <= v && v <= hi;
+        case '!': return lo != v || hi != v;
+        case '<': return lo < v;
+        case '>': return hi > v;
+        case 'l': return lo <= v;
+        default:  return hi >= v;
+    }
+}
+
+/* ------------------- Index Files ------------------- */
+/*
+   saveAll() writes the indexes (and zone maps) that are current next to
+   the snapshot as FILE.idx: a header, then each index's arrays at
+   64-byte aligned offsets, byte for byte as they sit in memory. The
+   header carries the snapshot's generation (the gen= field of its header
+   row), size and mtime. loadAll() maps the file and, when all three match and a few
+   sampled entries agree with the parsed roster, adopts the arrays in
+   place (copy-on-write), so startup does no index work.
+
+   When the file is missing or stale, a background thread rebuilds the
+   stale indexes and, if the roster still matches the snapshot, writes a
+   fresh file. Until it finishes, lookups and searches scan instead of
+   waiting; commands that change the roster wait for it first. Names
+   loaded lazily are left to the first search, which needs them anyway.
+*/
+
+#define INDEX_MAGIC "SMSIDX2"
+#define INDEX_BYTE_ORDER 0x01020304u
+#define INDEX_BACKGROUND_MIN 65536  // smaller rosters rebuild on first use, as before
+
+enum { IX_ROLL_SLOTS, IX_ROLL_TREE, IX_NAME_SLOTS, IX_WORDS, IX_ZONES, IX_SECTIONS };
+
+typedef struct {
+    char magic[8];
+    uint32_t byteOrder;
+    int32_t count;                  // records in the snapshot
+    uint64_t gen, dataBytes;        // the snapshot's generation and size
+    int64_t dataMtime;              // nanoseconds
+    uint32_t rollMask, nameMask;
+    int32_t rollTreeSize, wordCount;
+    int32_t zoneCount, zoneBlock;
+    uint64_t off[IX_SECTIONS], bytes[IX_SECTIONS];   // bytes == 0: not saved
+} IndexFileHeader;
+
+typedef struct {
+    uint64_t gen, dataBytes;
+    int64_t dataMtime;
+    int count;
+} SnapshotStamp;
+
+static SnapshotStamp snapshot;      // the data file as last loaded or saved
+
+static struct { void *base; size_t bytes; } indexMap;
+
+static const char *indexPath() {
+    static char path[1024];
+    snprintf(path, sizeof(path), "%s.idx", dataFile);
+    return path;
+}
+
+static int64_t fileMtime(const char *path) {
+#ifdef _WIN32
+    (void)path;
+    return 0;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0) return 0;
+#ifdef __APPLE__
+    return (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#endif
+}
+
+// Generation for the next snapshot: increasing, and distinct across sessions.
+static uint64_t nextGeneration() {
+    uint64_t t = (uint64_t)time(NULL) << 24;
+    return (t > snapshot.gen ? t : snapshot.gen) + 1;
+}
+
+int indexMapped(const void *p) {
+    return p && indexMap.base && (const char *)p >= (const char *)indexMap.base
+        && (const char *)p < (const char *)indexMap.base + indexMap.bytes;
+}
+
+void releaseIndexMap() {
+    if (!indexMap.base || indexMapped(rollSlots) || indexMapped(rollTree) || indexMapped(nameSlots) || indexMapped(words)
+        || indexMapped(zones))
+        return;
+#ifndef _WIN32
+    munmap(indexMap.base, indexMap.bytes);
+#endif
+    indexMap.base = NULL;
+    indexMap.bytes = 0;
+}
+
+/*
+   Writes FILE.idx for the snapshot described by st, through a temporary
+   file and a rename. NULL arrays are left out. Reads only its
+   arguments, so the background builder can call it too.
+*/
+static int writeIndexFile(const SnapshotStamp *st, const RollSlot *slots, unsigned rollMaskArg,
+                          const RollSlot *tree, const NameIndex *names, const Zone *zonesArg) {
+    double t0 = spanStart();
+    IndexFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, INDEX_MAGIC, sizeof(h.magic));
+    h.byteOrder = INDEX_BYTE_ORDER;
+    h.count = st->count;
+    h.gen = st->gen;
+    h.dataBytes = st->dataBytes;
+    h.dataMtime = st->dataMtime;
+    const void *data[IX_SECTIONS] = { slots, tree, names ? names->slots : NULL, names ? names->words : NULL, zonesArg };
+    if (slots) { h.rollMask = rollMaskArg; h.bytes[IX_ROLL_SLOTS] = sizeof(RollSlot) * ((uint64_t)rollMaskArg + 1); }
+    if (tree) { h.rollTreeSize = st->count; h.bytes[IX_ROLL_TREE] = sizeof(RollSlot) * ((uint64_t)st->count + 1); }
+    if (names) {
+        h.nameMask = names->mask;
+        h.wordCount = names->wordCount;
+        h.bytes[IX_NAME_SLOTS] = sizeof(NameSlot) * ((uint64_t)names->mask + 1);
+        h.bytes[IX_WORDS] = sizeof(WordRef) * (uint64_t)names->wordCount;
+    }
+    if (zonesArg) {
+        h.zoneCount = (st->count + ZONE_BLOCK - 1) / ZONE_BLOCK;
+        h.zoneBlock = ZONE_BLOCK;
+        h.bytes[IX_ZONES] = sizeof(Zone) * (uint64_t)h.zoneCount;
+    }
+    uint64_t off = (sizeof(h) + 63) & ~(uint64_t)63;
+    for (int k = 0; k < IX_SECTIONS; ++k) {
+        if (!h.bytes[k]) continue;
+        h.off[k] = off;
+        off = (off + h.bytes[k] + 63) & ~(uint64_t)63;
+    }
+
+    char tmp[1024 + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", indexPath());
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) return 0;
+    static const char pad[64];
+    int ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+    uint64_t pos = sizeof(h);
+    for (int k = 0; ok && k < IX_SECTIONS; ++k) {
+        if (!h.bytes[k]) continue;
+        ok = fwrite(pad, 1, (size_t)(h.off[k] - pos), fp) == h.off[k] - pos
+          && fwrite(data[k], 1, (size_t)h.bytes[k], fp) == h.bytes[k];
+        pos = h.off[k] + h.bytes[k];
+    }
+    if (fclose(fp) != 0) ok = 0;
+#ifdef _WIN32
+    if (ok) remove(indexPath());
+#endif
+    if (!ok || rename(tmp, indexPath()) != 0) { remove(tmp); return 0; }
+    traceSpan("write index file", "save", t0, "bytes", (long long)pos);
+    return 1;
+}
+
+// After a snapshot is written: persist whichever indexes are current.
+static void saveIndexes() {
+    NameIndex names = { nameSlots, nameMask, words, wordCount };
+    const RollSlot *slots = rollIndexStale ? NULL : rollSlots;
+    const RollSlot *tree = sortedRollStale ? NULL : rollTree;
+    if (!zoneMapStale) refreshZones();
+    if (!slots && !tree && nameIndexStale && zoneMapStale) { remove(indexPath()); return; }
+    if (!writeIndexFile(&snapshot, slots, rollMask, tree, nameIndexStale ? NULL : &names, zoneMapStale ? NULL : zones))
+        printf("Error: cannot write %s\n", indexPath());
+}
+
+// A few evenly spaced entries of each section must agree with the roster.
+#define INDEX_SAMPLES 64
+
+static int sampleRollSlots(const RollSlot *t, uint64_t n) {
+    for (uint64_t k = 0; k < n; k += n / INDEX_SAMPLES + 1)
+        if (t[k].idx >= studentCount || (t[k].idx >= 0 && students[t[k].idx].roll != t[k].roll)) return 0;
+    return 1;
+}
+
+static int sampleNameSlots(const NameSlot *t, uint64_t n) {
+    for (uint64_t k = 0; k < n; k += n / INDEX_SAMPLES + 1)
+        if (t[k].idx >= studentCount
+            || (t[k].idx >= 0 && !students[t[k].idx].lazyName && hashName(students[t[k].idx].folded) != t[k].hash))
+            return 0;
+    return 1;
+}
+
+static int sampleWords(const WordRef *w, uint64_t n) {
+    for (uint64_t k = 0; k < n; k += n / INDEX_SAMPLES + 1)
+        if (w[k].idx < 0 || w[k].idx >= studentCount || w[k].off >= MAX_NAME) return 0;
+    return 1;
+}
+
+static int sampleZones(const Zone *z, int n) {
+    for (int b = 0; b < n; b += n / INDEX_SAMPLES + 1) {
+        Zone fresh;
+        summarizeZone(&fresh, b, studentCount);
+        if (z[b].rollMin != fresh.rollMin || z[b].rollMax != fresh.rollMax || z[b].subjMin != fresh.subjMin
+            || z[b].subjMax != fresh.subjMax || z[b].avgMin != fresh.avgMin || z[b].avgMax != fresh.avgMax) return 0;
+    }
+    return 1;
+}
+
+/*
+   Called by loadAll() once the snapshot is parsed: adopts every section
+   of FILE.idx that belongs to it. Anything missing stays stale.
+*/
+void mapIndexFile() {
+#ifndef _WIN32
+    int fd = open(indexPath(), O_RDONLY);
+    if (fd < 0) return;
+    double t0 = spanStart();
+    struct stat st;
+    void *base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(IndexFileHeader))
+        base = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return;
+    size_t size = (size_t)st.st_size;
+    const IndexFileHeader *h = base;
+    int adopted = 0;
+    int ok = memcmp(h->magic, INDEX_MAGIC, sizeof(h->magic)) == 0 && h->byteOrder == INDEX_BYTE_ORDER
+          && h->gen == snapshot.gen && h->dataBytes == snapshot.dataBytes && h->dataMtime == snapshot.dataMtime
+          && h->count == studentCount;
+    for (int k = 0; ok && k < IX_SECTIONS; ++k)
+        if (h->bytes[k] && (h->off[k] % 64 || h->off[k] > size || h->bytes[k] > size - h->off[k])) ok = 0;
+    if (ok) {
+        const char *p = base;
+        uint64_t rollCap = (uint64_t)h->rollMask + 1, nameCap = (uint64_t)h->nameMask + 1;
+        if (h->bytes[IX_ROLL_SLOTS] == sizeof(RollSlot) * rollCap && !(rollCap & (rollCap - 1))
+            && sampleRollSlots((const RollSlot *)(p + h->off[IX_ROLL_SLOTS]), rollCap)) {
+            installRollIndex((RollSlot *)(p + h->off[IX_ROLL_SLOTS]), h->rollMask);
+            adopted++;
+        }
+        if (h->rollTreeSize == studentCount && h->bytes[IX_ROLL_TREE] == sizeof(RollSlot) * ((uint64_t)studentCount + 1)
+            && sampleRollSlots((const RollSlot *)(p + h->off[IX_ROLL_TREE]) + 1, (uint64_t)studentCount)) {
+            installRollTree((RollSlot *)(p + h->off[IX_ROLL_TREE]), studentCount);
+            adopted++;
+        }
+        if (h->bytes[IX_NAME_SLOTS] == sizeof(NameSlot) * nameCap && !(nameCap & (nameCap - 1))
+            && h->wordCount >= 0 && h->bytes[IX_WORDS] == sizeof(WordRef) * (uint64_t)h->wordCount
+            && sampleNameSlots((const NameSlot *)(p + h->off[IX_NAME_SLOTS]), nameCap)
+            && sampleWords((const WordRef *)(p + h->off[IX_WORDS]), (uint64_t)h->wordCount)) {
+            NameIndex ix = { (NameSlot *)(p + h->off[IX_NAME_SLOTS]), h->nameMask,
+                             (WordRef *)(p + h->off[IX_WORDS]), h->wordCount };
+            installNameIndex(&ix);
+            adopted++;
+        }
+        int blocks = (studentCount + ZONE_BLOCK - 1) / ZONE_BLOCK;
+        if (h->zoneBlock == ZONE_BLOCK && h->zoneCount == blocks && h->bytes[IX_ZONES] == sizeof(Zone) * (uint64_t)blocks
+            && sampleZones((const Zone *)(p + h->off[IX_ZONES]), blocks)) {
+            installZones((Zone *)(p + h->off[IX_ZONES]), blocks, blocks);
+            adopted++;
+        }
+    }
+    if (!adopted) { munmap(base, size); return; }
+    indexMap.base = base;
+    indexMap.bytes = size;
+    traceSpan("map index file", "load", t0, "indexes", adopted);
+#endif
+}
+
+/*
+   Background rebuild after a load. The builder reads students[] and
+   writes only its own job; the command thread installs the results in
+   indexBuildBusy() or waitIndexBuild().
+*/
+typedef struct {
+    SnapshotStamp stamp;
+    int n;                          // records to index
+    int persist;                    // the roster still matches the snapshot on disk
+    int roll, tree, names, zones;   // which indexes to build
+    RollSlot *slots; unsigned mask;
+    RollSlot *rollTreeOut;
+    NameIndex nameIx;
+    Zone *zonesOut; int zoneCount, zoneCap;
+    int builtRoll, builtTree, builtNames, builtZones;
+    long long ns[4];
+    const RollSlot *keepSlots, *keepTree;   // current indexes to write alongside
+    unsigned keepMask;
+    NameIndex keepNames;
+    const Zone *keepZones;
+} IndexBuild;
+
+static IndexBuild indexJob;
+static int indexBuildRunning = 0;   // touched by the command thread only
+static atomic_int indexBuildDone;
+#ifndef _WIN32
+static pthread_t indexBuilder;
+
+static void *runIndexBuild(void *arg) {
+    IndexBuild *b = arg;
+    workerSlot = BACKGROUND_SLOT;
+    int n = b->n;
+    double t0 = spanStart();
+    if (b->roll && (b->slots = buildRollSlots(n, NULL, 0, &b->mask)))
+        { b->builtRoll = 1; b->ns[0] = noteIndexBuild("roll", n, t0); }
+    t0 = spanStart();
+    if (b->tree && (b->rollTreeOut = buildRollTree(n)))
+        { b->builtTree = 1; b->ns[1] = noteIndexBuild("sorted_roll", n, t0); }
+    t0 = spanStart();
+    if (b->names && buildNameIndex(n, &b->nameIx))
+        { b->builtNames = 1; b->ns[2] = noteIndexBuild("name", n, t0); }
+    t0 = spanStart();
+    if (b->zones && (b->zonesOut = buildZones(n, &b->zoneCount, &b->zoneCap)))
+        { b->builtZones = 1; b->ns[3] = noteIndexBuild("zones", b->zoneCount, t0); }
+
+    if (b->persist) {
+        const RollSlot *slots = b->builtRoll ? b->slots : b->keepSlots;
+        const RollSlot *tree = b->builtTree ? b->rollTreeOut : b->keepTree;
+        const NameIndex *names = b->builtNames ? &b->nameIx : b->keepNames.slots ? &b->keepNames : NULL;
+        writeIndexFile(&b->stamp, slots, b->builtRoll ? b->mask : b->keepMask, tree, names,
+                       b->builtZones ? b->zonesOut : b->keepZones);
+    }
+    atomic_store(&indexBuildDone, 1);
+    return NULL;
+}
+#endif
+
+static void finishIndexBuild() {
+#ifndef _WIN32
+    pthread_join(indexBuilder, NULL);
+#endif
+    indexBuildRunning = 0;
+    IndexBuild *b = &indexJob;
+    if (b->builtRoll) { installRollIndex(b->slots, b->mask); metricObserve(&metrics.indexBuilds, "roll", b->ns[0]); }
+    if (b->builtTree) { installRollTree(b->rollTreeOut, b->n); metricObserve(&metrics.indexBuilds, "sorted_roll", b->ns[1]); }
+    if (b->builtNames) { installNameIndex(&b->nameIx); metricObserve(&metrics.indexBuilds, "name", b->ns[2]); }
+    if (b->builtZones) { installZones(b->zonesOut, b->zoneCount, b->zoneCap); metricObserve(&metrics.indexBuilds, "zones", b->ns[3]); }
+}
+
+// Nonzero while a background build runs; installs its results once it is done.
+int indexBuildBusy() {
+    if (!indexBuildRunning) return 0;
+    if (!atomic_load(&indexBuildDone)) return 1;
+    finishIndexBuild();
+    return 0;
+}
+
+void waitIndexBuild() {
+    if (indexBuildRunning) finishIndexBuild();
+}
+
+// Starts rebuilding whatever loadAll() could not adopt from FILE.idx.
+void startIndexBuild() {
+#ifndef _WIN32
+    static int registered = 0;
+    if (indexBuildRunning || studentCount < INDEX_BACKGROUND_MIN) return;
+    IndexBuild *b = &indexJob;
+    memset(b, 0, sizeof(*b));
+    b->roll = rollIndexStale;
+    b->tree = sortedRollStale;
+    b->names = nameIndexStale && !namesPending;
+    b->zones = zoneMapStale;
+    if (!b->roll && !b->tree && !b->names && !b->zones) return;
+    b->stamp = snapshot;
+    b->n = studentCount;
+    b->persist = !rosterDirty && snapshot.count == studentCount;
+    if (!rollIndexStale) { b->keepSlots = rollSlots; b->keepMask = rollMask; }
+    if (!sortedRollStale) b->keepTree = rollTree;
+    if (!nameIndexStale) b->keepNames = (NameIndex){ nameSlots, nameMask, words, wordCount };
+    if (!zoneMapStale) b->keepZones = zones;
+    atomic_store(&indexBuildDone, 0);
+    if (pthread_create(&indexBuilder, NULL, runIndexBuild, b) != 0) return;   // indexes build on first use
+    indexBuildRunning = 1;
+    if (!registered) { atexit(waitIndexBuild); registered = 1; }
+#endif
+}
+
+/* ---------------- Duplicate Index ------------------ */
+/*
+   Hash of each record's normalized name: folded, with punctuation such
+   as '.' and '\'' dropped and any run of spaces, commas or hyphens
+   collapsed to one space. "Anne-Marie  O'Neil" and "anne marie oneil"
+   share a key. Probing the table finds likely duplicates in O(1);
+   callers may also require an identical marks signature.
+   Rebuilt lazily after moves and renames; appends go in place.
+*/
+
+typedef struct { uint64_t hash; int idx; } DupSlot;   // idx < 0: empty
+
+static DupSlot *dupSlots = NULL;
+static unsigned dupMask = 0;
+static int dupEntries = 0;
+
+static void normalizeName(const char *folded, char *out, size_t cap) {
+    size_t n = 0;
+    int gap = 0;
+    for (const unsigned char *p = (const unsigned char *)folded; *p && n + 2 < cap; ++p) {
+        if (*p == ' ' || *p == ',' || *p == '-' || *p == '_' || *p == '\t') { gap = n > 0; continue; }
+        if (*p < 0x80 && !isalnum(*p)) continue;             // . ' " and other marks vanish
+        if (gap) { out[n++] = ' '; gap = 0; }
+        out[n++] = (char)*p;
+    }
+    out[n] = '\0';
+}
+
+static uint64_t dupKey(const char *folded, char *norm, size_t cap) {
+    normalizeName(folded, norm, cap);
+    return bloomKeyName(norm);
+}
+
+static void dupIndexInsert(uint64_t h, int idx) {
+    unsigned k = (unsigned)h & dupMask;
+    while (dupSlots[k].idx >= 0) k = (k + 1) & dupMask;
+    dupSlots[k].hash = h;
+    dupSlots[k].idx = idx;
+    dupEntries++;
+}
+
+typedef struct { DupSlot *slots; unsigned mask; } DupTable;
+
+static void dupSlotKey(BulkItem *it, int idx, const void *ctx) {
+    (void)ctx;
+    char norm[MAX_NAME];
+    it->key = dupKey(students[idx].folded, norm, sizeof(norm));
+}
+
+static int dupPlace(void *table, const BulkItem *it, unsigned limit) {
+    DupTable *t = table;
+    for (unsigned i = (unsigned)it->key & t->mask;;) {
+        if (t->slots[i].idx < 0) {
+            t->slots[i].hash = it->key;
+            t->slots[i].idx = it->idx;
+            return 1;
+        }
+        if (++i == limit) return 0;
+        i &= t->mask;
+    }
+}
+
+static void rebuildDupIndex() {
+    materializeNames();
+    double t0 = spanStart();
+    unsigned cap = 16;
+    while (cap < (unsigned)studentCount * 2) cap <<= 1;
+    if (cap != dupMask + 1 || !dupSlots) {
+        DupSlot *slots = bigAlloc(sizeof(DupSlot) * cap);
+        if (!slots) return;
+        bigFree(dupSlots);
+        dupSlots = slots;
+        dupMask = cap - 1;
+    }
+    for (unsigned k = 0; k <= dupMask; ++k) dupSlots[k].idx = -1;
+    dupEntries = 0;
+    DupTable t = { dupSlots, dupMask };
+    BulkItem *items = bulkGather(studentCount, dupSlotKey, NULL);
+    if (items && bulkFill(items, studentCount, dupMask + 1, 0, dupPlace, &t)) {
+        dupEntries = studentCount;
+    } else {                                                // no memory to spare: insert one by one
+        char norm[MAX_NAME];
+        for (int i = 0; i < studentCount; ++i) dupIndexInsert(dupKey(students[i].folded, norm, sizeof(norm)), i);
+    }
+    free(items);
+    dupIndexStale = 0;
+    noteIndexBuild("duplicate", studentCount, t0);
+}
+
+// Call after appending students[idx] (name already set).
+void dupIndexAppended(int idx) {
+    if (dupIndexStale) return;
+    if ((unsigned)(dupEntries + 1) * 2 > dupMask + 1) { dupIndexStale = 1; return; }
+    char norm[MAX_NAME];
+    dupIndexInsert(dupKey(students[idx].folded, norm, sizeof(norm)), idx);
+}
+
+static int sameMarks(const Student *a, const Student *b) {
+    if (a->subjectCount != b->subjectCount) return 0;
+    for (int i = 0; i < a->subjectCount; ++i)
+        if (a->marks[i] != b->marks[i]) return 0;
+    return 1;
+}
+
+/*
+   Calls fn(idx, ctx) for every record other than `self` that looks like
+   a duplicate of s, until fn returns nonzero. Returns the match count,
+   or -1 if the index could not be built.
+*/
+int forEachDuplicate(const Student *s, int self, int withMarks, int (*fn)(int idx, void *ctx), void *ctx) {
+    if (dupIndexStale) rebuildDupIndex();
+    if (dupIndexStale) return -1;
+    char norm[MAX_NAME], other[MAX_NAME];
+    uint64_t h = dupKey(s->folded, norm, sizeof(norm));
+    if (!norm[0]) return 0;
+    int n = 0;
+    for (unsigned k = (unsigned)h & dupMask; dupSlots[k].idx >= 0; k = (k + 1) & dupMask) {
+        int j = dupSlots[k].idx;
+        if (dupSlots[k].hash != h || j == self) continue;
+        normalizeName(students[j].folded, other, sizeof(other));
+        if (strcmp(norm, other) != 0 || (withMarks && !sameMarks(s, &students[j]))) continue;
+        n++;
+        if (fn && fn(j, ctx)) break;
+    }
+    return n;
+}
+
+static int firstMatch(int idx, void *ctx) { *(int *)ctx = idx; return 1; }
+
+static void printDuplicateNote(const char *prefix, const Student *s, int j, int withMarks) {
+    printf("%s\"%s\" looks like Roll %d (%s)%s\n", prefix, s->name, students[j].roll, studentName(&students[j]),
+           !withMarks && sameMarks(s, &students[j]) ? ", same marks" : "");
+}
+
+// Roster position of one likely duplicate of s, or -1.
+int findDuplicate(const Student *s, int withMarks) {
+    int found = -1;
+    forEachDuplicate(s, -1, withMarks, firstMatch, &found);
+    return found;
+}
+
+/* -------------- Persistence (CSV) ------------------ */
+/*
+   CSV format (one line per student):
+   roll,name,subjectCount,marks_semicolon_separated,average,grade
+
+   Example:
+   1,Alice Johnson,3,85;90;78,84.33,B
+   2,"Smith, John",2,70;64,67.00,C
+
+   The header row ends with gen=HEX, the snapshot's generation, which
+   FILE.idx must match (see Index Files). With --wal it also carries
+   lsn=N, the last log record the snapshot includes.
+*/
+
+static int walEnabled = 0;             // --wal
+static int walSync = 0;                // --wal-sync: fsync after each record
+static FILE *walFp = NULL;
+static uint64_t walLsn = 0;            // last LSN written or recovered
+static uint64_t snapshotLsn = 0;       // LSN covered by the loaded / last saved snapshot
+static int walSinceCheckpoint = 0;
+static int checkpointEvery = 10000;    // --checkpoint-every
+
+void walRecover();
+void waitLoad();
+
+static const char *walPath() {
+    static char path[1024];
+    snprintf(path, sizeof(path), "%s.wal", dataFile);
+    return path;
+}
+
+// A non-empty log means recovery will still change the roster after the load.
+static int walHasTail() {
+    FILE *fp = fopen(walPath(), "rb");
+    if (!fp) return 0;
+    int tail = fgetc(fp) != EOF;
+    fclose(fp);
+    return tail;
+}
+
+// Flushes fp and forces its contents to disk. 0 on failure.
+static int syncFile(FILE *fp) {
+    if (fflush(fp) != 0) return 0;
+#ifdef _WIN32
+    return 1;
+#else
+    return fsync(fileno(fp)) == 0;
+#endif
+}
+
+// Makes a rename into path's directory durable. 0 on failure.
+static int syncParentDir(const char *path) {
+#ifdef _WIN32
+    (void)path;
+    return 1;
+#else
+    char dir[1024];
+    const char *slash = strrchr(path, '/');
+    if (!slash) snprintf(dir, sizeof(dir), ".");
+    else snprintf(dir, sizeof(dir), "%.*s", slash == path ? 1 : (int)(slash - path), path);
+    int fd = open(dir, O_RDONLY);
+    if (fd < 0) return 0;
+    int ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+#endif
+}
+
+/*
+   Rows are parsed in parallel: one sequential pass over the structural
+   index splits the file into chunks at row ends and counts each chunk's
+   rows, so every chunk knows where its records start. Workers then
+   parse their chunks straight into students[], and a final pass closes
+   the gaps left by malformed rows.
+
+   Large snapshots with no log tail load progressively: after the read
+   and the structural scan loadAll() returns, and background threads
+   parse the chunks in file order. Each parsed chunk is moved down behind
+   the records published so far, so the roster fills in as a prefix that
+   never moves again. Roll and name lookups (CMD_PARTIAL) search that
+   prefix and block only until it holds what they need; everything else
+   calls waitLoad() first. studentCount stays 0 until the load finishes
+   on the command thread.
+*/
+
+#define LOAD_CHUNKS (4 * BACKGROUND_SLOT)       // 4 per thread at the --threads cap
+#define LOAD_PROGRESSIVE_MIN (8 << 20)  // bytes; smaller files parse before anyone could ask
+
+typedef struct {
+    char *buf;
+    size_t size;
+    const CsvIndex *ix;
+    size_t kStart[LOAD_CHUNKS + 1];     // chunk c covers structural positions [kStart[c], kStart[c+1])
+    int base[LOAD_CHUNKS], limit[LOAD_CHUNKS];
+    int valid[LOAD_CHUNKS], lazy[LOAD_CHUNKS];
+} LoadJob;
+
+// roll, name, subjectCount, marks_list, average, grade
+static int parseRow(char **field, int fields, const char *buf, Student *s) {
+    if (fields != 6) return 0;
+    memset(s, 0, sizeof(*s));
+    s->roll = atoi(field[0]);
+
+    // name: unquoted now, or just located when lazy
+    if (lazyNames) s->lazyName = (int)(field[1] - buf) + 1;
+    else {
+        csvUnquote(field[1], s->name, MAX_NAME);
+        trimUtf8Tail(s->name);
+        foldName(s->name, s->folded, MAX_NAME);
+    }
+
+    s->subjectCount = atoi(field[2]);
+    if (s->subjectCount < 1 || s->subjectCount > MAX_SUBJECTS) return 0;
+
+    // marks list (semicolon separated)
+    int idx = 0;
+    char *mp = field[3], *mend;
+    while (idx < s->subjectCount) {
+        long v = strtol(mp, &mend, 10);
+        if (mend == mp) break;
+        s->marks[idx++] = (int)v;
+        if (*mend != ';') break;
+        mp = mend + 1;
+    }
+    if (idx != s->subjectCount) return 0;  // malformed line
+
+    s->average = (float)atof(field[4]);
+    s->grade = field[5][0];
+    return s->grade != '\0';
+}
+
+// walk fields between structural positions; a '\n' ends the row
+static void parseChunks(void *ctx, int begin, int end) {
+    LoadJob *job = ctx;
+    char *buf = job->buf;
+    const CsvIndex *ix = job->ix;
+    for (int c = begin; c < end; ++c) {
+        Student *out = students + job->base[c];
+        char *field[8];
+        int nf = 0, n = 0, lazy = 0;
+        size_t start = job->kStart[c] ? ix->pos[job->kStart[c] - 1] + 1 : 0;
+        for (size_t k = job->kStart[c]; k < job->kStart[c + 1] && n < job->limit[c]; ++k) {
+            size_t stop = k < ix->count ? ix->pos[k] : job->size;
+            int rowEnd = k == ix->count || buf[stop] == '\n';
+            if (k == ix->count && start >= stop) break;     // trailing newline
+            if (stop > start && buf[stop - 1] == '\r') buf[stop - 1] = '\0';
+            buf[stop] = '\0';
+            if (nf < 8) field[nf] = buf + start;
+            nf++;
+            start = stop + 1;
+            if (!rowEnd) continue;
+
+            int fields = nf;
+            nf = 0;
+            if (!parseRow(field, fields, buf, &out[n])) continue;
+            if (out[n].lazyName) lazy++;
+            n++;
+        }
+        job->valid[c] = n;
+        job->lazy[c] = lazy;
+    }
+}
+
+// Writes a snapshot to FILE.tmp and renames it over dataFile; with --wal this is a checkpoint.
+void saveAll() {
+    waitLoad();
+    waitIndexBuild();
+    double t0 = spanStart();
+    PROBE1(save__start, studentCount);
+    char tmp[1024];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", dataFile);
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) {
+        printf("Error: cannot write to %s\n", tmp);
+        return;
+    }
+    materializeNames();
+    uint64_t gen = nextGeneration();
+    fprintf(fp, "roll,name,subjectCount,marks,average,grade,gen=%llx", (unsigned long long)gen);
+    if (walFp) fprintf(fp, ",lsn=%llu", (unsigned long long)walLsn);
+    fputc('\n', fp);
+    for (int i = 0; i < studentCount; ++i) {
+        Student *s = &students[i];
+        fprintf(fp, "%d,", s->roll);
+        writeCsvField(fp, s->name);
+        fprintf(fp, ",%d,", s->subjectCount);
+        // marks list
+        for (int j = 0; j < s->subjectCount; ++j) {
+            fprintf(fp, "%d", s->marks[j]);
+            if (j != s->subjectCount - 1) fprintf(fp, ";");
+        }
+        fprintf(fp, ",%.2f,%c\n", s->average, s->grade);
+    }
+    long bytes = ftell(fp);
+    int ok = !ferror(fp) && syncFile(fp);                  // on disk before it can replace the old snapshot
+    if (fclose(fp) != 0) ok = 0;
+#ifdef _WIN32
+    if (ok) remove(dataFile);                               // rename() does not replace on Windows
+#endif
+    if (!ok || rename(tmp, dataFile) != 0) {
+        printf("Error: cannot write to %s\n", dataFile);
+        remove(tmp);
+        return;
+    }
+    int durable = syncParentDir(dataFile);
+    snapshot = (SnapshotStamp){ gen, (uint64_t)bytes, fileMtime(dataFile), studentCount };
+    rosterDirty = 0;
+    saveIndexes();
+    if (walFp && !durable) printf("Warning: cannot sync the directory of %s; keeping the log\n", dataFile);
+    if (walFp && durable) {                                 // the snapshot covers the whole log
+        snapshotLsn = walLsn;
+        walSinceCheckpoint = 0;
+        walFp = freopen(walPath(), "wb", walFp);
+    }
+    long long ns = nsSince(t0);
+    PROBE3(save__done, studentCount, bytes, ns);
+    traceSpan("saveAll", "save", t0, "bytes", bytes);
+    metrics.saves++;
+    metrics.bytesWritten += bytes;
+    metrics.saveSeconds += ns / 1e9;
+}
+
+// Everything after parsing: indexes, stamps, metrics, log recovery.
+static void finishLoad(char *buf, long size, double t0) {
+    if (namesPending) loadBuf = buf;    // names still point into it
+    else free(buf);
+    bloomsInvalidate();
+    rosterChanged();
+    rosterDirty = 0;
+    snapshot.dataBytes = (uint64_t)size;
+    snapshot.dataMtime = fileMtime(dataFile);
+    snapshot.count = studentCount;
+    mapIndexFile();
+    long long ns = nsSince(t0);
+    PROBE3(load__done, studentCount, size, ns);
+    traceSpan("loadAll", "load", t0, "records", studentCount);
+    metrics.loads++;
+    metrics.recordsLoaded += studentCount;
+    metrics.bytesRead += size;
+    metrics.loadSeconds += ns / 1e9;
+    walRecover();
+    startIndexBuild();
+}
+
+#ifndef _WIN32
+typedef struct {
+    LoadJob job;
+    CsvIndex ix;
+    char *buf;
+    long size;
+    double t0, tParse;
+    int chunks;
+    atomic_int nextChunk;               // parse threads claim chunks in file order
+    pthread_mutex_t lock;               // guards everything below
+    pthread_cond_t progress;            // the prefix grew or a thread finished
+    unsigned char ready[LOAD_CHUNKS];   // parsed but not yet published
+    int published;                      // chunks [0, published) are in place
+    int count, lazy;                    // records and pending names in that prefix
+    int running;                        // parse threads still working
+    pthread_t tid[MAX_WORKERS];
+    int threads;
+} ProgressiveLoad;
+
+static ProgressiveLoad *loading = NULL;  // touched by the command thread only
+
+static void *runLoadThread(void *arg) {
+    ProgressiveLoad *pl = arg;
+    LoadJob *job = &pl->job;
+    workerSlot = BACKGROUND_SLOT;
+    int c;
+    while ((c = atomic_fetch_add(&pl->nextChunk, 1)) < pl->chunks) {
+        parseChunks(job, c, c + 1);
+        pthread_mutex_lock(&pl->lock);
+        pl->ready[c] = 1;
+        int grew = 0;
+        // every chunk before `published` is in place, so the move never touches one still being parsed
+        for (; pl->published < pl->chunks && pl->ready[pl->published]; pl->published++, grew = 1) {
+            int p = pl->published;
+            if (job->base[p] != pl->count)
+                memmove(students + pl->count, students + job->base[p], sizeof(Student) * (size_t)job->valid[p]);
+            pl->count += job->valid[p];
+            pl->lazy += job->lazy[p];
+        }
+        if (grew) pthread_cond_broadcast(&pl->progress);
+        pthread_mutex_unlock(&pl->lock);
+    }
+    pthread_mutex_lock(&pl->lock);
+    pl->running--;
+    pthread_cond_broadcast(&pl->progress);
+    pthread_mutex_unlock(&pl->lock);
+    return NULL;
+}
+
+// Takes over job, ix and buf; 0 (and nothing taken) if no thread could start.
+static int startProgressiveLoad(const LoadJob *job, int chunks, const CsvIndex *ix, char *buf, long size,
+                                double t0, double tParse) {
+    ProgressiveLoad *pl = calloc(1, sizeof(ProgressiveLoad));
+    if (!pl) return 0;
+    pl->job = *job;
+    pl->ix = *ix;
+    pl->job.ix = &pl->ix;
+    pl->buf = buf;
+    pl->size = size;
+    pl->t0 = t0;
+    pl->tParse = tParse;
+    pl->chunks = chunks;
+    atomic_init(&pl->nextChunk, 0);
+    pthread_mutex_init(&pl->lock, NULL);
+    pthread_cond_init(&pl->progress, NULL);
+    pthread_mutex_lock(&pl->lock);
+    for (int t = 0; t < workerCount(); ++t) {
+        if (pthread_create(&pl->tid[t], NULL, runLoadThread, pl) != 0) break;
+        pl->threads++;
+    }
+    pl->running = pl->threads;
+    pthread_mutex_unlock(&pl->lock);
+    if (!pl->threads) {
+        pthread_cond_destroy(&pl->progress);
+        pthread_mutex_destroy(&pl->lock);
+        free(pl);
+        return 0;
+    }
+    loading = pl;
+    return 1;
+}
+
+// Blocks until more than `seen` records are published or parsing ends; returns the published count.
+static int waitLoadProgress(int seen) {
+    ProgressiveLoad *pl = loading;
+    pthread_mutex_lock(&pl->lock);
+    while (pl->count <= seen && pl->running) pthread_cond_wait(&pl->progress, &pl->lock);
+    int count = pl->count;
+    pthread_mutex_unlock(&pl->lock);
+    return count;
+}
+
+static void joinProgressiveLoad() {
+    ProgressiveLoad *pl = loading;
+    for (int t = 0; t < pl->threads; ++t) pthread_join(pl->tid[t], NULL);
+    loading = NULL;
+    studentCount = pl->count;
+    namesPending = pl->lazy;
+    free(pl->ix.pos);
+    traceSpan("parse rows", "load", pl->tParse, "records", studentCount);
+    char *buf = pl->buf;
+    long size = pl->size;
+    double t0 = pl->t0;
+    pthread_cond_destroy(&pl->progress);
+    pthread_mutex_destroy(&pl->lock);
+    free(pl);
+    finishLoad(buf, size, t0);
+}
+
+// Nonzero while records are still being parsed; finishes the load once they are all in.
+int loadBusy() {
+    if (!loading) return 0;
+    pthread_mutex_lock(&loading->lock);
+    int running = loading->running;
+    pthread_mutex_unlock(&loading->lock);
+    if (running) return 1;
+    joinProgressiveLoad();
+    return 0;
+}
+
+void waitLoad() {
+    if (loading) joinProgressiveLoad();
+}
+
+// First record with this roll, checking chunks as they are published; call while loadBusy().
+int findLoadingRoll(int roll) {
+    int from = 0, to;
+    while ((to = waitLoadProgress(from)) > from) {
+        for (int i = from; i < to; ++i)
+            if (students[i].roll == roll) return i;
+        from = to;
+    }
+    return -1;
+}
+
+// scanNames() over the published prefix, waiting for more only while the limit is not met.
+int scanLoadingNames(const char *query, int limit, int *out) {
+    int hits = 0, from = 0, to;
+    if (limit < 0) limit = 0;
+    while ((!limit || hits < limit) && (to = waitLoadProgress(from)) > from) {
+        hits += scanNameRange(query, limit ? limit - hits : 0, out + hits, from, to);
+        from = to;
+    }
+    return hits;
+}
+#else
+static int startProgressiveLoad(const LoadJob *job, int chunks, const CsvIndex *ix, char *buf, long size,
+                                double t0, double tParse) {
+    (void)job; (void)chunks; (void)ix; (void)buf; (void)size; (void)t0; (void)tParse;
+    return 0;
+}
+int loadBusy() { return 0; }
+void waitLoad() {}
+int findLoadingRoll(int roll) { (void)roll; return -1; }
+int scanLoadingNames(const char *query, int limit, int *out) { (void)query; (void)limit; (void)out; return 0; }
+#endif
+
+void loadAll() {
+    double t0 = spanStart();
+    PROBE1(load__start, dataFile);
+    FILE *fp = fopen(dataFile, "rb");
+    studentCount = 0;
+    namesPending = 0;
+    free(loadBuf);
+    loadBuf = NULL;
+    snapshotLsn = 0;
+    memset(&snapshot, 0, sizeof(snapshot));
+    if (!fp) {
+        // no existing file — start fresh (a log alone still replays)
+        walRecover();
+        return;
+    }
+
+    // read the whole file once; lines are parsed in place
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *buf = size > 0 ? malloc((size_t)size + 1) : NULL;
+    if (!buf || fread(buf, 1, (size_t)size, fp) != (size_t)size) {
+        free(buf);
+        fclose(fp);
+        return;
+    }
+    fclose(fp);
+    buf[size] = '\0';
+    traceSpan("read file", "load", t0, "bytes", size);
+
+    double tScan = spanStart();
+    CsvIndex ix = {0};
+    if (!csvIndexBuild(buf, (size_t)size, &ix)) {
+        free(ix.pos);
+        free(buf);
+        return;
+    }
+    traceSpan("structural scan", "load", tScan, "delimiters", (long long)ix.count);
+    double tParse = spanStart();
+
+    // header row: skipped, and may carry the log sequence number the snapshot covers
+    size_t kFirst = 0;
+    if (strncmp(buf, "roll", 4) == 0 && (buf[4] == ',' || buf[4] == '\n' || buf[4] == '\r' || !buf[4])) {
+        while (kFirst < ix.count && buf[ix.pos[kFirst]] != '\n') kFirst++;
+        size_t headerEnd = kFirst < ix.count ? ix.pos[kFirst] : (size_t)size;
+        for (size_t p = 0; p + 5 <= headerEnd; ++p) {
+            if (memcmp(buf + p, ",lsn=", 5) == 0) snapshotLsn = strtoull(buf + p + 5, NULL, 10);
+            if (memcmp(buf + p, ",gen=", 5) == 0) snapshot.gen = strtoull(buf + p + 5, NULL, 16);
+        }
+        kFirst++;
+    }
+
+    // split into chunks at row ends, counting rows per chunk
+    LoadJob *job = calloc(1, sizeof(LoadJob));
+    if (!job) { free(ix.pos); free(buf); return; }
+    job->buf = buf;
+    job->size = (size_t)size;
+    job->ix = &ix;
+    int progressive = size >= LOAD_PROGRESSIVE_MIN && !lazyNames && !walHasTail();
+    int chunks = progressive ? LOAD_CHUNKS : size < (1 << 20) ? 1 : workerCount() * 4;
+    int c = 0, rows = 0;
+    long total = 0;
+    job->kStart[0] = kFirst;
+    for (size_t k = kFirst; k < ix.count; ++k) {
+        if (buf[ix.pos[k]] != '\n') continue;
+        rows++;
+        if (c + 1 < chunks && k + 1 >= kFirst + (ix.count - kFirst) * (size_t)(c + 1) / chunks) {
+            job->base[c] = (int)(total < MAX_STUDENTS ? total : MAX_STUDENTS);
+            job->limit[c] = rows;
+            total += rows;
+            rows = 0;
+            job->kStart[++c] = k + 1;
+        }
+    }
+    job->base[c] = (int)(total < MAX_STUDENTS ? total : MAX_STUDENTS);
+    job->limit[c] = rows + 1;                               // last row may lack a newline
+    total += rows + 1;
+    chunks = c + 1;
+    job->kStart[chunks] = ix.count + 1;
+    for (c = 0; c < chunks; ++c)                            // rows past MAX_STUDENTS are dropped
+        if (job->base[c] + (long)job->limit[c] > MAX_STUDENTS) job->limit[c] = MAX_STUDENTS - job->base[c];
+
+    if (!reserveStudents((int)(total < MAX_STUDENTS ? total : MAX_STUDENTS))) { free(job); free(ix.pos); free(buf); return; }
+    if (progressive && startProgressiveLoad(job, chunks, &ix, buf, size, t0, tParse)) { free(job); return; }
+    parallelFor(chunks, 1, parseChunks, job);
+
+    // close the gaps left by malformed rows
+    for (c = 0; c < chunks; ++c) {
+        if (job->base[c] != studentCount)
+            memmove(students + studentCount, students + job->base[c], sizeof(Student) * (size_t)job->valid[c]);
+        studentCount += job->valid[c];
+        namesPending += job->lazy[c];
+    }
+    free(job);
+    free(ix.pos);
+    traceSpan("parse rows", "load", tParse, "records", studentCount);
+    finishLoad(buf, size, t0);
+}
+
+/* ---------------- Write-Ahead Log ------------------ */
+/*
+   With --wal, a change appends one record to students.csv.wal instead of
+   rewriting the CSV. Every --checkpoint-every records (and on 'checkpoint'
+   or menu exit) saveAll() writes a snapshot whose header row carries the
+   LSN it covers, then truncates the log.
+
+   Record: u32 crc32 | u32 payload length | u64 lsn | payload, where the
+   CRC covers everything after itself. Recovery stops at the first short
+   or corrupt record (a torn write from a crash) and cuts it off. A
+   transaction's records follow a WAL_TXN marker holding their count;
+   recovery takes them only if all of them made it, else cuts from the
+   marker.
+
+   Appends are group-committed: see walAwait().
+
+   Startup loads the snapshot in parallel and replays only records newer
+   than its LSN. Between sorts, records on different rolls commute, so
+   the tail is partitioned by roll hash: each worker folds its rolls'
+   records into a final state and writes updates in place; deletes and
+   appends are then applied once, in log order.
+*/
+
+enum { WAL_ADD = 1, WAL_RENAME, WAL_MARKS, WAL_DELETE, WAL_SORT, WAL_TXN };
+
+#define WAL_HEADER 16
+#define WAL_MAX_RECORD (WAL_HEADER + 16 + MAX_SUBJECTS + MAX_NAME)
+
+typedef struct {
+    uint64_t lsn;
+    int op, roll;                   // WAL_TXN: roll holds the number of records that follow
+    int subjectCount;
+    int marks[MAX_SUBJECTS];
+    char name[MAX_NAME];
+    char sortKey;                   // WAL_SORT: 'r', 'n' or 'a'
+    char desc;
+} WalRecord;
+
+static uint32_t crcTable[256];
+
+static uint32_t crc32(const unsigned char *p, size_t n) {
+    if (!crcTable[1])
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            crcTable[i] = c;
+        }
+    uint32_t c = 0xFFFFFFFFu;
+    while (n--) c = crcTable[(c ^ *p++) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+static size_t walEncode(const WalRecord *r, unsigned char *out) {
+    unsigned char *p = out + WAL_HEADER;
+    *p++ = (unsigned char)r->op;
+    memcpy(p, &r->roll, 4); p += 4;
+    if (r->op == WAL_ADD || r->op == WAL_MARKS) {
+        *p++ = (unsigned char)r->subjectCount;
+        for (int i = 0; i < r->subjectCount; ++i) *p++ = (unsigned char)r->marks[i];
+    }
+    if (r->op == WAL_ADD || r->op == WAL_RENAME) {
+        size_t len = strlen(r->name);
+        *p++ = (unsigned char)len;
+        memcpy(p, r->name, len); p += len;
+    }
+    if (r->op == WAL_SORT) { *p++ = (unsigned char)r->sortKey; *p++ = (unsigned char)r->desc; }
+
+    uint32_t len = (uint32_t)(p - out - WAL_HEADER);
+    memcpy(out + 4, &len, 4);
+    memcpy(out + 8, &r->lsn, 8);
+    uint32_t crc = crc32(out + 4, (size_t)(p - out - 4));
+    memcpy(out, &crc, 4);
+    return (size_t)(p - out);
+}
+
+// Decodes one record at p (avail bytes); returns its size, or 0 if torn or corrupt.
+static size_t walDecode(const unsigned char *p, size_t avail, WalRecord *r) {
+    uint32_t crc, len;
+    if (avail < WAL_HEADER) return 0;
+    memcpy(&crc, p, 4);
+    memcpy(&len, p + 4, 4);
+    if (len < 5 || len > avail - WAL_HEADER || crc32(p + 4, len + WAL_HEADER - 4) != crc) return 0;
+    memset(r, 0, sizeof(*r));
+    memcpy(&r->lsn, p + 8, 8);
+    const unsigned char *q = p + WAL_HEADER, *end = q + len;
+    r->op = *q++;
+    memcpy(&r->roll, q, 4); q += 4;
+    if (r->op == WAL_ADD || r->op == WAL_MARKS) {
+        if (q >= end) return 0;
+        r->subjectCount = *q++;
+        if (r->subjectCount < 1 || r->subjectCount > MAX_SUBJECTS || q + r->subjectCount > end) return 0;
+        for (int i = 0; i < r->subjectCount; ++i) r->marks[i] = *q++;
+    }
+    if (r->op == WAL_ADD || r->op == WAL_RENAME) {
+        if (q >= end) return 0;
+        size_t n = *q++;
+        if (n >= MAX_NAME || q + n > end) return 0;
+        memcpy(r->name, q, n); q += n;
+    }
+    if (r->op == WAL_SORT) {
+        if (q + 2 > end) return 0;
+        r->sortKey = (char)q[0]; r->desc = (char)q[1];
+    }
+    return r->op >= WAL_ADD && r->op <= WAL_TXN ? WAL_HEADER + len : 0;
+}
+
+// Whether the `count` records after a WAL_TXN marker at `lsn` are all intact.
+static int walTxnComplete(const unsigned char *p, size_t avail, int count, uint64_t lsn) {
+    WalRecord r;
+    size_t off = 0, n;
+    for (int i = 0; i < count; ++i, off += n) {
+        if (!(n = walDecode(p + off, avail - off, &r)) || r.lsn <= lsn || r.op == WAL_TXN || r.op == WAL_SORT) return 0;
+        lsn = r.lsn;
+    }
+    return 1;
+}
+
+/*
+   Group commit. Writers encode their records into walPending, taking
+   LSNs in buffer order, then wait in walAwait() until a write covers
+   their last LSN. A waiter that finds no write in flight becomes the
+   leader: it takes everything pending, writes it with one fwrite, fflush
+   and (--wal-sync) fsync outside the lock, and wakes the rest. Writers
+   arriving meanwhile fill the other buffer and share the next flush.
+*/
+
+static unsigned char *walPending = NULL, *walSpare = NULL;   // encoded, not yet written
+static size_t walPendingLen = 0, walPendingCap = 0, walSpareCap = 0;
+static uint64_t walPendingLsn = 0;      // last LSN in walPending
+static uint64_t walDurableLsn = 0;      // written (and with --wal-sync, synced) up to here
+static uint64_t walFailedLsn = 0;       // the latest failed write covered up to here
+static int walFlushing = 0;
+static long walFlushes = 0, walRecordsWritten = 0;
+#ifndef _WIN32
+static pthread_mutex_t walLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t walFlushed = PTHREAD_COND_INITIALIZER;
+#endif
+
+static void lockWal() {
+#ifndef _WIN32
+    pthread_mutex_lock(&walLock);
+#endif
+}
+
+static void unlockWal() {
+#ifndef _WIN32
+    pthread_mutex_unlock(&walLock);
+#endif
+}
+
+// Assigns LSNs to recs[0, n) and queues them; returns the last LSN, or 0 if out of memory.
+static uint64_t walEnqueue(WalRecord *recs, int n) {
+    lockWal();
+    size_t need = walPendingLen + (size_t)n * WAL_MAX_RECORD;
+    if (need > walPendingCap) {
+        size_t cap = walPendingCap ? walPendingCap : 1 << 16;
+        while (cap < need) cap *= 2;
+        unsigned char *grown = realloc(walPending, cap);
+        if (!grown) { unlockWal(); return 0; }
+        walPending = grown;
+        walPendingCap = cap;
+    }
+    for (int i = 0; i < n; ++i) {
+        recs[i].lsn = ++walLsn;
+        walPendingLen += walEncode(&recs[i], walPending + walPendingLen);
+    }
+    walPendingLsn = walLsn;
+    walRecordsWritten += n;
+    uint64_t last = walLsn;
+    unlockWal();
+    return last;
+}
+
+// Waits until every record up to lsn is written. 0 if the write failed.
+static int walAwait(uint64_t lsn) {
+    lockWal();
+    while (walDurableLsn < lsn && walFailedLsn < lsn) {
+#ifndef _WIN32
+        if (walFlushing) { pthread_cond_wait(&walFlushed, &walLock); continue; }
+#endif
+        walFlushing = 1;
+        unsigned char *buf = walPending;
+        size_t len = walPendingLen, cap = walPendingCap;
+        uint64_t upto = walPendingLsn;
+        walPending = walSpare; walPendingCap = walSpareCap; walPendingLen = 0;
+        unlockWal();
+        int ok = fwrite(buf, 1, len, walFp) == len && fflush(walFp) == 0;
+#ifndef _WIN32
+        if (ok && walSync) ok = fsync(fileno(walFp)) == 0;
+#endif
+        lockWal();
+        walSpare = buf; walSpareCap = cap;
+        if (ok) walDurableLsn = upto;
+        else walFailedLsn = upto;
+        walFlushes++;
+        walFlushing = 0;
+#ifndef _WIN32
+        pthread_cond_broadcast(&walFlushed);
+#endif
+    }
+    int ok = walFailedLsn < lsn;
+    unlockWal();
+    return ok;
+}
+
+static void walWrite(WalRecord *r) {
+    if (!walFp) return;
+    uint64_t lsn = walEnqueue(r, 1);
+    if (!lsn || !walAwait(lsn)) {
+        printf("Error: cannot append to %s; saving a snapshot instead.\n", walPath());
+        saveAll();
+        return;
+    }
+    walSinceCheckpoint++;
+}
+
+// Logs a change to s (WAL_ADD, WAL_RENAME, WAL_MARKS or WAL_DELETE).
+void walLog(int op, const Student *s) {
+    if (!walFp) return;
+    WalRecord r = {0};
+    r.op = op;
+    r.roll = s->roll;
+    r.subjectCount = s->subjectCount;
+    memcpy(r.marks, s->marks, sizeof(r.marks));
+    if (op == WAL_ADD || op == WAL_RENAME) strcpy(r.name, s->name);
+    walWrite(&r);
+}
+
+void walLogSort(char key, int desc) {
+    if (!walFp) return;
+    WalRecord r = {0};
+    r.op = WAL_SORT;
+    r.sortKey = key;
+    r.desc = (char)desc;
+    walWrite(&r);
+}
+
+// Persists a finished change: a full save, or with --wal a checkpoint when due.
+void saveChanges() {
+    if (!walFp || walSinceCheckpoint >= checkpointEvery) saveAll();
+}
+
+/* WAL replay */
+
+typedef struct {
+    int roll, orig;                 // roll 0: empty slot; orig: position at segment start, or -1
+    int exists, removeOrig;
+    uint64_t addLsn;
+    Student s;
+} RollState;
+
+typedef struct {
+    const WalRecord *recs;
+    int begin, end, parts;
+    RollState *table[MAX_WORKERS * 4];
+    unsigned mask[MAX_WORKERS * 4];
+    unsigned char *dead;
+} ReplayJob;
+
+int sortRoster(char key, int desc);
+
+static void replayPartitions(void *ctx, int pBegin, int pEnd) {
+    ReplayJob *job = ctx;
+    for (int p = pBegin; p < pEnd; ++p) {
+        int owned = 0;
+        for (int i = job->begin; i < job->end; ++i)
+            if (hashRoll(job->recs[i].roll) % (unsigned)job->parts == (unsigned)p) owned++;
+        unsigned cap = 16;
+        while (cap < (unsigned)owned * 2) cap <<= 1;
+        RollState *t = arenaAlloc(threadArena(), sizeof(RollState) * cap);
+        job->table[p] = t;
+        job->mask[p] = t ? cap - 1 : 0;
+        if (!t) continue;                                   // replayRoster() checks
+        memset(t, 0, sizeof(RollState) * cap);
+
+        for (int i = job->begin; i < job->end; ++i) {
+            const WalRecord *r = &job->recs[i];
+            unsigned h = hashRoll(r->roll);
+            if (h % (unsigned)job->parts != (unsigned)p) continue;
+            unsigned k = h & (cap - 1);
+            while (t[k].roll && t[k].roll != r->roll) k = (k + 1) & (cap - 1);
+            RollState *st = &t[k];
+            if (!st->roll) {
+                st->roll = r->roll;
+                st->orig = findIndexByRoll(r->roll);        // index is built; lookups are read-only
+                if (st->orig >= 0) { st->s = students[st->orig]; st->exists = 1; }
+            }
+            switch (r->op) {
+            case WAL_ADD:
+                if (st->orig >= 0) st->removeOrig = 1;
+                memset(&st->s, 0, sizeof(st->s));
+                st->s.roll = r->roll;
+                strcpy(st->s.name, r->name);
+                st->s.subjectCount = r->subjectCount;
+                memcpy(st->s.marks, r->marks, sizeof(r->marks));
+                st->exists = 1;
+                st->addLsn = r->lsn;
+                break;
+            case WAL_RENAME:
+                if (st->exists) strcpy(st->s.name, r->name);
+                break;
+            case WAL_MARKS:
+                if (st->exists) {
+                    st->s.subjectCount = r->subjectCount;
+                    memcpy(st->s.marks, r->marks, sizeof(r->marks));
+                }
+                break;
+            case WAL_DELETE:
+                if (st->orig >= 0) st->removeOrig = 1;
+                st->exists = 0;
+                break;
+            }
+        }
+
+        // settle each roll: update in place, or mark the original for removal
+        for (unsigned k = 0; k < cap; ++k) {
+            RollState *st = &t[k];
+            if (!st->roll) continue;
+            if (st->exists) {
+                trimUtf8Tail(st->s.name);
+                foldName(st->s.name, st->s.folded, MAX_NAME);
+                recompute(&st->s);
+            }
+            if (st->orig >= 0 && st->removeOrig) job->dead[st->orig] = 1;
+            else if (st->orig >= 0 && st->exists) students[st->orig] = st->s;
+        }
+    }
+}
+
+static int cmpAddLsn(const void *a, const void *b) {
+    const RollState *x = *(RollState *const *)a, *y = *(RollState *const *)b;
+    return x->addLsn < y->addLsn ? -1 : x->addLsn > y->addLsn;
+}
+
+// Applies recs[begin, end) (no sorts inside) to the roster. Scratch comes from threadArena().
+static int replaySegment(const WalRecord *recs, int begin, int end) {
+    ReplayJob *job = arenaAlloc(threadArena(), sizeof(ReplayJob));
+    unsigned char *dead = arenaAlloc(threadArena(), (size_t)studentCount + 1);
+    if (!job || !dead) return 0;
+    memset(job, 0, sizeof(ReplayJob));
+    memset(dead, 0, (size_t)studentCount + 1);
+    job->recs = recs;
+    job->begin = begin;
+    job->end = end;
+    job->parts = end - begin < 4096 ? 1 : workerCount() * 4;
+    if (job->parts > MAX_WORKERS * 4) job->parts = MAX_WORKERS * 4;
+    job->dead = dead;
+    if (studentCount) findIndexByRoll(students[0].roll);    // build lookup structures before going parallel
+    parallelFor(job->parts, 1, replayPartitions, job);
+
+    int ok = 1, appends = 0;
+    for (int p = 0; p < job->parts; ++p) {
+        if (!job->table[p]) { ok = 0; continue; }
+        for (unsigned k = 0; k <= job->mask[p]; ++k) {
+            RollState *st = &job->table[p][k];
+            if (st->roll && st->exists && (st->orig < 0 || st->removeOrig)) appends++;
+        }
+    }
+    RollState **added = ok ? arenaAlloc(threadArena(), sizeof(RollState *) * (size_t)(appends + 1)) : NULL;
+    if (!added) ok = 0;
+    if (ok) {
+        int n = 0;
+        for (int p = 0; p < job->parts; ++p)
+            for (unsigned k = 0; k <= job->mask[p]; ++k) {
+                RollState *st = &job->table[p][k];
+                if (st->roll && st->exists && (st->orig < 0 || st->removeOrig)) added[n++] = st;
+            }
+        qsort(added, n, sizeof(RollState *), cmpAddLsn);
+
+        int kept = 0;
+        for (int i = 0; i < studentCount; ++i)
+            if (!dead[i]) students[kept++] = students[i];
+        studentCount = kept;
+        if (!reserveStudents(studentCount + n)) ok = 0;
+        for (int i = 0; ok && i < n; ++i) students[studentCount++] = added[i]->s;
+    }
+    rosterChanged();
+    return ok;
+}
+
+/*
+   Reads the log next to dataFile, cuts off a torn tail and replays every
+   record newer than the snapshot. Without --wal a leftover log is folded
+   into a fresh snapshot and removed.
+*/
+void walRecover() {
+    const char *path = walPath();
+    FILE *fp = fopen(path, "rb");
+    if (fp) {
+        double t0 = nowSeconds();
+        fseek(fp, 0, SEEK_END);
+        long size = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        unsigned char *buf = size > 0 ? malloc((size_t)size) : NULL;
+        size_t got = buf ? fread(buf, 1, (size_t)size, fp) : 0;
+        fclose(fp);
+        int failed = size > 0 && got != (size_t)size;       // no memory, or a read error: not a torn tail
+
+        WalRecord *recs = NULL;
+        int count = 0, cap = 0;
+        size_t off = 0, n;
+        WalRecord r;
+        uint64_t last = 0;
+        walLsn = snapshotLsn;
+        while (off < got && (n = walDecode(buf + off, got - off, &r)) && r.lsn > last) {
+            if (r.op == WAL_TXN && !walTxnComplete(buf + off + n, got - off - n, r.roll, r.lsn)) break;   // torn batch: cut whole
+            off += n;
+            last = walLsn = r.lsn > walLsn ? r.lsn : walLsn;
+            if (r.op == WAL_TXN || r.lsn <= snapshotLsn) continue;   // marker, or already in the snapshot
+            if (count == cap) {
+                int ncap = cap ? cap * 2 : 1024;
+                WalRecord *grown = realloc(recs, sizeof(WalRecord) * (size_t)ncap);
+                if (!grown) { failed = 1; break; }
+                recs = grown; cap = ncap;
+            }
+            recs[count++] = r;
+        }
+        free(buf);
+        if (failed) {                                       // going on would let the next save drop the log
+            printf("Error: cannot read %s into memory; leaving it untouched.\n", path);
+            free(recs);
+            exit(1);
+        }
+        if (off < (size_t)size) {
+            printf("WAL: discarding %ld torn byte(s) at the end of %s\n", size - (long)off, path);
+#ifndef _WIN32
+            if (truncate(path, (off_t)off) != 0) printf("Error: cannot truncate %s\n", path);
+#endif
+        }
+
+        if (count) {
+            materializeNames();
+            int begin = 0;
+            for (int i = 0; i <= count; ++i) {
+                if (i < count && recs[i].op != WAL_SORT) continue;
+                if (i > begin && !replaySegment(recs, begin, i)) printf("Error: out of memory replaying %s\n", path);
+                resetScratch();                             // recovery runs outside any command
+                if (i < count) sortRoster(recs[i].sortKey, recs[i].desc);
+                begin = i + 1;
+            }
+            bloomsInvalidate();
+            traceSpan("wal replay", "load", t0, "records", count);
+            printf("WAL: replayed %d change(s) after LSN %llu in %.3f s\n", count,
+                   (unsigned long long)snapshotLsn, nowSeconds() - t0);
+        }
+        free(recs);
+        walSinceCheckpoint = count;
+    }
+
+    if (!walEnabled) {
+        if (fp) { saveAll(); remove(path); }               // fold a leftover log into the snapshot
+        return;
+    }
+    walFp = fopen(path, "ab");
+    if (!walFp) printf("Error: cannot open %s; changes will be saved as full snapshots.\n", path);
+}
+
+void walClose() {
+    if (walFp) fclose(walFp);
+    walFp = NULL;
+}
+
+/* ------------------ Transactions ------------------- */
+/*
+   A Txn stages adds, renames, marks and deletes as log records instead
+   of applying them. txnCommit() checks the whole batch first (every roll
+   it touches must exist at that point, counting the batch's own earlier
+   adds and deletes; the roster must have room for the adds), then as one
+   step under txnLock:
+     - gives the staged adds their rolls
+     - queues the batch on the log behind a WAL_TXN marker
+     - applies it through replaySegment(), the path recovery uses, so
+       the indexes are rebuilt once for the whole batch
+   and finally waits outside the lock for the group commit that writes
+   it, so transactions committed from several threads share one flush.
+   A rejected batch changes nothing. Without --wal the commit is one
+   snapshot save. Staged changes are invisible until the commit.
+
+   txnLock orders committers only. Applying compacts and rewrites
+   students[] without the record versions, like sort and delete, so
+   readers must not overlap a commit: commands run one at a time, so
+   another command never sees a batch half applied, but code reading the
+   roster from other threads has to be kept off it by the caller.
+*/
+
+typedef struct {
+    WalRecord *recs;                // recs[0]: the WAL_TXN marker
+    int count, cap;
+} Txn;
+
+typedef struct { int roll, exists; } TxnRoll;   // roll 0: empty slot
+
+#ifndef _WIN32
+static pthread_mutex_t txnLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static const char *walOpName(int op) {
+    return op == WAL_ADD ? "add" : op == WAL_RENAME ? "rename" : op == WAL_MARKS ? "marks" : "delete";
+}
+
+Txn *txnBegin() {
+    Txn *t = calloc(1, sizeof(Txn));
+    if (!t) return NULL;
+    t->cap = 64;
+    t->recs = calloc((size_t)t->cap, sizeof(WalRecord));
+    if (!t->recs) { free(t); return NULL; }
+    t->recs[0].op = WAL_TXN;
+    t->count = 1;
+    return t;
+}
+
+// Number of staged changes.
+int txnSize(const Txn *t) {
+    return t->count - 1;
+}
+
+// Stages a change to s, as walLog() would log it (an add's roll is assigned at commit). 0 if out of memory.
+int txnStage(Txn *t, int op, const Student *s) {
+    if (t->count == t->cap) {
+        WalRecord *grown = realloc(t->recs, sizeof(WalRecord) * (size_t)t->cap * 2);
+        if (!grown) return 0;
+        t->recs = grown;
+        t->cap *= 2;
+    }
+    WalRecord *r = &t->recs[t->count++];
+    memset(r, 0, sizeof(*r));
+    r->op = op;
+    r->roll = op == WAL_ADD ? 0 : s->roll;
+    r->subjectCount = s->subjectCount;
+    memcpy(r->marks, s->marks, sizeof(r->marks));
+    if (op == WAL_ADD || op == WAL_RENAME) {
+        snprintf(r->name, sizeof(r->name), "%s", s->name);
+        trimUtf8Tail(r->name);
+    }
+    return 1;
+}
+
+void txnAbort(Txn *t) {
+    if (!t) return;
+    free(t->recs);
+    free(t);
+}
+
+// Checks the staged batch against the roster and assigns the adds' rolls. 0 (with err) to reject.
+static int txnValidate(Txn *t, char *err, size_t errSize) {
+    int n = txnSize(t), adds = 0;
+    unsigned cap = 16;
+    while (cap < (unsigned)n * 2) cap <<= 1;
+    TxnRoll *seen = calloc(cap, sizeof(TxnRoll));
+    if (!seen) { snprintf(err, errSize, "out of memory"); return 0; }
+    int nextRoll = findMaxRoll() + 1, ok = 1;
+    for (int i = 1; ok && i <= n; ++i) {
+        WalRecord *r = &t->recs[i];
+        if (r->op == WAL_ADD) { r->roll = nextRoll++; adds++; }
+        unsigned k = hashRoll(r->roll) & (cap - 1);
+        while (seen[k].roll && seen[k].roll != r->roll) k = (k + 1) & (cap - 1);
+        if (!seen[k].roll) {
+            seen[k].roll = r->roll;
+            seen[k].exists = r->op != WAL_ADD && findIndexByRoll(r->roll) >= 0;
+        }
+        if (r->op != WAL_ADD && !seen[k].exists) {
+            snprintf(err, errSize, "change %d (%s): no student with roll %d", i, walOpName(r->op), r->roll);
+            ok = 0;
+        }
+        seen[k].exists = r->op != WAL_DELETE;
+        r->lsn = (uint64_t)i;                               // orders the adds when there is no log
+    }
+    free(seen);
+    if (ok && !reserveStudents(studentCount + adds)) {
+        snprintf(err, errSize, "no room for %d more student(s)", adds);
+        ok = 0;
+    }
+    return ok;
+}
+
+/*
+   Commits and frees t. Returns the number of changes applied, or -1 if
+   the batch was rejected (err says why) and nothing changed.
+*/
+int txnCommit(Txn *t, char *err, size_t errSize) {
+    int n = txnSize(t);
+    if (n == 0) { txnAbort(t); return 0; }
+#ifndef _WIN32
+    pthread_mutex_lock(&txnLock);
+#endif
+    int ok = txnValidate(t, err, errSize), logged = walFp != NULL;
+    uint64_t last = 0;
+    t->recs[0].roll = n;
+    if (ok && logged && !(last = walEnqueue(t->recs, t->count))) {
+        snprintf(err, errSize, "out of memory");
+        ok = 0;
+    }
+    if (ok) {
+        double t0 = spanStart();
+        materializeNames();
+        if (!replaySegment(t->recs, 1, t->count)) printf("Error: out of memory applying the transaction\n");
+        bloomsInvalidate();
+        for (int i = 1; i <= n; ++i) noteMutation(walOpName(t->recs[i].op), t->recs[i].roll);
+        traceSpan("txn apply", "command", t0, "records", n);
+        if (logged) walSinceCheckpoint += n;
+    }
+#ifndef _WIN32
+    pthread_mutex_unlock(&txnLock);
+#endif
+    txnAbort(t);
+    if (!ok) return -1;
+    int durable = !logged || walAwait(last);
+#ifndef _WIN32
+    pthread_mutex_lock(&txnLock);
+#endif
+    if (!durable) printf("Error: cannot append to %s; saving a snapshot instead.\n", walPath());
+    if (!durable || !walFp || walSinceCheckpoint >= checkpointEvery) {
+        if (walFp) walAwait(walLsn);                        // nothing may be mid-write while the log is truncated
+        saveAll();
+    }
+#ifndef _WIN32
+    pthread_mutex_unlock(&txnLock);
+#endif
+    return n;
+}
+
+static Txn *openTxn = NULL;         // begin ... commit in a batch or session
+
+// Stages a command's change in the open transaction.
+static int stageChange(int op, const Student *s) {
+    if (!txnStage(openTxn, op, s)) { printf("Error: out of memory\n"); return 1; }
+    printf("Staged %s (%d change(s) pending).\n", walOpName(op), txnSize(openTxn));
+    return 0;
+}
+
+// begin
+int cmdBegin(int argc, char **argv) {
+    (void)argc; (void)argv;
+    if (openTxn) { printf("A transaction is already open.\n"); return 1; }
+    if (!(openTxn = txnBegin())) { printf("Error: out of memory\n"); return 1; }
+    printf("Transaction started: add, rename, marks and delete are staged until commit.\n");
+    return 0;
+}
+
+// commit
+int cmdCommit(int argc, char **argv) {
+    (void)argc; (void)argv;
+    if (!openTxn) { printf("No transaction is open.\n"); return 1; }
+    Txn *t = openTxn;
+    char err[160];
+    int firstRoll = findMaxRoll() + 1, adds = 0;        // txnValidate() numbers the adds from here, in staging order
+    for (int i = 1; i < t->count; ++i) adds += t->recs[i].op == WAL_ADD;
+    openTxn = NULL;
+    int n = txnCommit(t, err, sizeof(err));
+    if (n < 0) { printf("Transaction rolled back: %s.\n", err); return 1; }
+    printf("✅ Committed %d change(s).\n", n);
+    for (int roll = firstRoll; roll < firstRoll + adds; ++roll) {
+        int idx = findIndexByRoll(roll);
+        if (idx < 0) continue;                              // deleted later in the same batch
+        Student *s = &students[idx];
+        printf("✅ Added: Roll %d | %s | Avg: %.2f | Grade: %c\n", roll, s->name, s->average, s->grade);
+    }
+    return 0;
+}
+
+// abort
+int cmdAbort(int argc, char **argv) {
+    (void)argc; (void)argv;
+    if (!openTxn) { printf("No transaction is open.\n"); return 1; }
+    printf("Transaction aborted: %d staged change(s) dropped.\n", txnSize(openTxn));
+    txnAbort(openTxn);
+    openTxn = NULL;
+    return 0;
+}
+
+/* -------------------- UI Helpers ------------------- */
+
+void printBanner() {
+    printf("==============================================\n");
+    printf("     Student Management System – v1.0 (C)     \n");
+    printf("==============================================\n");
+}
+
+void printTableHeader() {
+    printf("\n%-6s  %-25s  %-8s  %-8s  %-5s\n", "Roll", "Name", "Subjects", "Average", "Grade");
+    printf("------  -------------------------  --------  --------  -----\n");
+}
+
+void printStudentRow(Student *s) {
+    printf("%-6d  ", s->roll);
+    printPadded(stdout, studentName(s), 25);
+    printf("  %-8d  %-8.2f  %-5c\n", s->subjectCount, s->average, s->grade);
+}
+
+/* -------------------- Core Actions ----------------- */
+/*
+   Every operation is a command taking (argc, argv) so that the menu,
+   batch files and workload replay all go through runCommand(), which
+   records and times it. The interactive functions below only prompt,
+   then build the argument vector. Commands return 0 on success.
+*/
+
+int runCommand(int argc, char **argv);
+
+static int parseRollArg(const char *txt, int *roll) {
+    char *end;
+    long v = strtol(txt, &end, 10);
+    if (end == txt || *end || v < 1 || v > 1000000000) {
+        printf("Invalid roll number '%s'.\n", txt);
+        return 0;
+    }
+    *roll = (int)v;
+    return 1;
+}
+
+static int parseMarksArgs(int argc, char **argv, Student *s) {
+    if (argc < 1 || argc > MAX_SUBJECTS) {
+        printf("Expected 1-%d marks.\n", MAX_SUBJECTS);
+        return 0;
+    }
+    for (int i = 0; i < argc; ++i) {
+        char *end;
+        long v = strtol(argv[i], &end, 10);
+        if (end == argv[i] || *end || v < 0 || v > 100) {
+            printf("Invalid mark '%s' (0-100).\n", argv[i]);
+            return 0;
+        }
+        s->marks[i] = (int)v;
+    }
+    s->subjectCount = argc;
+    recompute(s);
+    return 1;
+}
+
+// add NAME MARK...
+int cmdAdd(int argc, char **argv) {
+    if (!reserveStudents(studentCount + 1)) {
+        printf("Cannot add more students (limit reached).\n");
+        return 1;
+    }
+
+    Student s = {0};
+    s.roll = findMaxRoll() + 1;
+
+    char buf[256];
+    strncpy(buf, argv[1], sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    if (strlen(buf) == 0) {
+        printf("Name cannot be empty.\n");
+        return 1;
+    }
+    strncpy(s.name, buf, MAX_NAME - 1);
+    nameChanged(&s);
+
+    if (!parseMarksArgs(argc - 2, argv + 2, &s)) return 1;
+    if (openTxn) return stageChange(WAL_ADD, &s);
+    int dup = findDuplicate(&s, 0);
+    students[studentCount++] = s;
+    studentAppended(studentCount - 1);
+    noteMutation("add", s.roll);
+    walLog(WAL_ADD, &s);
+    saveChanges();
+
+    printf("\n✅ Added: Roll %d | %s | Avg: %.2f | Grade: %c\n", s.roll, s.name, s.average, s.grade);
+    if (dup >= 0) printDuplicateNote("⚠️  Possible duplicate: ", &s, dup, 0);
+    return 0;
+}
+
+int listWhere(int argc, char **argv);
+
+// list [--where EXPR]...
+int cmdList(int argc, char **argv) {
+    if (argc > 1) return listWhere(argc, argv);
+    if (studentCount == 0) {
+        printf("No records to display.\n");
+        return 0;
+    }
+    materializeNames();
+    printTableHeader();
+    for (int i = 0; i < studentCount; ++i) printStudentRow(&students[i]);
+    return 0;
+}
+
+// roll ROLL
+int cmdSearchRoll(int argc, char **argv) {
+    (void)argc;
+    int roll;
+    if (!parseRollArg(argv[1], &roll)) return 1;
+    double t0 = spanStart();
+    int idx = findIndexByRoll(roll);
+    noteSearch("roll", argv[1], idx >= 0, t0);
+    if (idx < 0) { printf("No student with roll %d.\n", roll); return 0; }
+    printTableHeader();
+    printStudentRow(&students[idx]);
+    // show marks detail
+    printf("Marks: ");
+    for (int i = 0; i < students[idx].subjectCount; ++i) {
+        printf("%d", students[idx].marks[i]);
+        if (i != students[idx].subjectCount - 1) printf(", ");
+    }
+    printf("\n");
+    return 0;
+}
+
+typedef struct { int limit; int shown; } RangePrint;
+
+static int printRangeRow(int idx, void *ctx) {
+    RangePrint *rp = ctx;
+    printStudentRow(&students[idx]);
+    return ++rp->shown == rp->limit;
+}
+
+// rolls LO HI [LIMIT]
+int cmdRollRange(int argc, char **argv) {
+    int lo, hi;
+    if (!parseRollArg(argv[1], &lo) || !parseRollArg(argv[2], &hi)) return 1;
+    if (lo > hi) { printf("Empty range: %d > %d.\n", lo, hi); return 1; }
+    RangePrint rp = { argc > 3 ? atoi(argv[3]) : 0, 0 };
+    printTableHeader();
+    double t0 = spanStart();
+    if (scanRollRange(lo, hi, printRangeRow, &rp) < 0) { printf("Out of memory.\n"); return 1; }
+    noteSearch("rolls", argv[1], rp.shown, t0);
+    printf("\n%d record(s) with roll %d..%d%s\n", rp.shown, lo, hi, rp.limit && rp.shown == rp.limit ? " (limit reached)" : "");
+    return 0;
+}
+
+// name QUERY|=NAME [LIMIT]
+int cmdSearchName(int argc, char **argv) {
+    const char *q = argv[1];
+    if (strlen(q) == 0) { printf("Query empty.\n"); return 1; }
+    int limit = argc > 2 ? atoi(argv[2]) : 0;
+
+    materializeNames();
+    if (q[0] == '=') waitLoad();                           // exact names go through the name index
+    int partial = q[0] != '=' && loadBusy();
+    int room = partial ? studentCapacity : studentCount;   // the roster is still filling up
+    int *idx = arenaAlloc(threadArena(), sizeof(int) * (room ? room : 1));
+    if (!idx) { printf("Error: out of memory.\n"); return 1; }
+    double t0 = spanStart();
+    int hits = q[0] == '=' ? findByExactName(q + 1, idx, limit)
+             : partial ? scanLoadingNames(q, limit, idx) : scanNames(q, limit, idx);
+    noteSearch(q[0] == '=' ? "exact_name" : "name", q, hits, t0);
+    printTableHeader();
+    for (int i = 0; i < hits; ++i) printStudentRow(&students[idx[i]]);
+    if (!hits) printf("No matches for \"%s\".\n", q);
+    else if (limit > 0 && hits == limit) printf("(first %d matches shown)\n", limit);
+    return 0;
+}
+
+// find QUERY [N]
+int cmdFind(int argc, char **argv) {
+    int limit = argc > 2 ? atoi(argv[2]) : 10;
+    if (limit < 1) limit = 10;
+    SearchHit *hits = arenaAlloc(threadArena(), sizeof(SearchHit) * limit);
+    if (!hits) { printf("Error: out of memory.\n"); return 1; }
+
+    double t0 = nowSeconds();
+    int n = smartSearch(argv[1], limit, hits);
+    double us = (nowSeconds() - t0) * 1e6;
+    noteSearch("find", argv[1], n, t0);
+
+    if (!n) printf("No matches for \"%s\" (%.0f us).\n", argv[1], us);
+    else {
+        printf("\n%-9s  %-6s  %-25s  %-8s  %-5s\n", "Match", "Roll", "Name", "Average", "Grade");
+        printf("---------  ------  -------------------------  --------  -----\n");
+        for (int k = 0; k < n; ++k) {
+            Student *s = &students[hits[k].idx];
+            printf("%-9s  %-6d  ", tierNames[hits[k].tier], s->roll);
+            printPadded(stdout, s->name, 25);
+            printf("  %-8.2f  %-5c\n", s->average, s->grade);
+        }
+        printf("%d result(s) in %.0f us\n", n, us);
+    }
+    return 0;
+}
+
+// rename ROLL NAME
+int cmdRename(int argc, char **argv) {
+    (void)argc;
+    int roll;
+    if (!parseRollArg(argv[1], &roll)) return 1;
+    char buf[256];
+    strncpy(buf, argv[2], sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    if (strlen(buf) == 0) { printf("Name unchanged.\n"); return 1; }
+    if (openTxn) {
+        Student s = { .roll = roll };
+        size_t len = strlen(buf) < MAX_NAME - 1 ? strlen(buf) : MAX_NAME - 1;
+        memcpy(s.name, buf, len);                           // s is zeroed: stays terminated
+        return stageChange(WAL_RENAME, &s);
+    }
+    int idx = findIndexByRoll(roll);
+    if (idx < 0) { printf("No student with roll %d.\n", roll); return 1; }
+
+    studentName(&students[idx]);                 // settle any lazy name before overwriting
+    Student s;
+    unsigned seen = readStudent(idx, &s);
+    strncpy(s.name, buf, MAX_NAME - 1);
+    s.name[MAX_NAME - 1] = '\0';
+    nameChanged(&s);
+    if (!commitStudent(idx, seen, &s)) { printf("Roll %d changed meanwhile; not updated.\n", roll); return 1; }
+    dupIndexStale = 1;
+    noteMutation("rename", roll);
+    walLog(WAL_RENAME, &students[idx]);
+    saveChanges();
+    printf("✅ Updated successfully.\n");
+    return 0;
+}
+
+// marks ROLL MARK...
+int cmdSetMarks(int argc, char **argv) {
+    int roll;
+    if (!parseRollArg(argv[1], &roll)) return 1;
+    if (openTxn) {
+        Student s = { .roll = roll };
+        if (!parseMarksArgs(argc - 2, argv + 2, &s)) return 1;
+        return stageChange(WAL_MARKS, &s);
+    }
+    int idx = findIndexByRoll(roll);
+    if (idx < 0) { printf("No student with roll %d.\n", roll); return 1; }
+
+    Student s;
+    unsigned seen = readStudent(idx, &s);
+    if (!parseMarksArgs(argc - 2, argv + 2, &s)) return 1;
+    if (!commitStudent(idx, seen, &s)) { printf("Roll %d changed meanwhile; not updated.\n", roll); return 1; }
+    noteMutation("marks", roll);
+    walLog(WAL_MARKS, &students[idx]);
+    saveChanges();
+    printf("✅ Updated successfully.\n");
+    return 0;
+}
+
+// delete ROLL
+int cmdDelete(int argc, char **argv) {
+    (void)argc;
+    int roll;
+    if (!parseRollArg(argv[1], &roll)) return 1;
+    if (openTxn) {
+        Student s = { .roll = roll };
+        return stageChange(WAL_DELETE, &s);
+    }
+    int idx = findIndexByRoll(roll);
+    if (idx < 0) { printf("No student with roll %d.\n", roll); return 1; }
+
+    Student gone = students[idx];
+    if (gone.lazyName) namesPending--;
+    for (int i = idx; i < studentCount - 1; ++i) students[i] = students[i + 1];
+    studentCount--;
+    rosterChanged();
+    walLog(WAL_DELETE, &gone);                              // after applying: a failed append saves a snapshot without it
+    noteMutation("delete", roll);
+    saveChanges();
+    printf("✅ Deleted.\n");
+    return 0;
+}
+
+void addStudent() {
+    if (!reserveStudents(studentCount + 1)) {
+        printf("Cannot add more students (limit reached).\n");
+        return;
+    }
+
+    printf("Enter student name: ");
+    char buf[256];
+    safeGets(buf, sizeof(buf));
+    if (strlen(buf) == 0) {
+        printf("Name cannot be empty.\n");
+        return;
+    }
+
+    int count = inputIntInRange("Enter number of subjects (1-10): ", 1, MAX_SUBJECTS);
+    char marks[MAX_SUBJECTS][8];
+    char *argv[2 + MAX_SUBJECTS] = { "add", buf };
+    for (int i = 0; i < count; ++i) {
+        char prompt[64];
+        snprintf(prompt, sizeof(prompt), "Enter marks for subject %d (0-100): ", i + 1);
+        snprintf(marks[i], sizeof(marks[i]), "%d", inputIntInRange(prompt, 0, 100));
+        argv[2 + i] = marks[i];
+    }
+
+    Student probe = {0};
+    strncpy(probe.name, buf, MAX_NAME - 1);
+    foldName(probe.name, probe.folded, MAX_NAME);
+    int dup = findDuplicate(&probe, 0);
+    if (dup >= 0) {
+        char yn[8];
+        printf("\n⚠️  A student named %s already exists (Roll %d). Add anyway? (y/n): ",
+               studentName(&students[dup]), students[dup].roll);
+        safeGets(yn, sizeof(yn));
+        if (yn[0] != 'y' && yn[0] != 'Y') { printf("Cancelled.\n"); return; }
+    }
+    runCommand(2 + count, argv);
+}
+
+void listAll() {
+    char *argv[] = { "list" };
+    runCommand(1, argv);
+}
+
+void searchByRoll() {
+    if (studentCount == 0) { printf("No records.\n"); return; }
+    char roll[16];
+    snprintf(roll, sizeof(roll), "%d", inputIntInRange("Enter roll number: ", 1, 1000000000));
+    char *argv[] = { "roll", roll };
+    runCommand(2, argv);
+}
+
+void rollRangeMenu() {
+    if (studentCount == 0) { printf("No records.\n"); return; }
+    char lo[16], hi[16];
+    snprintf(lo, sizeof(lo), "%d", inputIntInRange("From roll: ", 1, 1000000000));
+    snprintf(hi, sizeof(hi), "%d", inputIntInRange("To roll  : ", 1, 1000000000));
+    char *argv[] = { "rolls", lo, hi };
+    runCommand(3, argv);
+}
+
+void searchByName() {
+    if (studentCount == 0) { printf("No records.\n"); return; }
+    char q[128], limit[16];
+    printf("Enter name (or part of it, * and ? allowed, =NAME for exact): ");
+    safeGets(q, sizeof(q));
+    if (strlen(q) == 0) { printf("Query empty.\n"); return; }
+    printf("Max results [all]: ");
+    safeGets(limit, sizeof(limit));
+    char *argv[] = { "name", q, limit };
+    runCommand(atoi(limit) > 0 ? 3 : 2, argv);
+}
+
+void smartSearchMenu() {
+    if (studentCount == 0) { printf("No records.\n"); return; }
+    char q[128];
+    printf("Enter name: ");
+    safeGets(q, sizeof(q));
+    if (strlen(q) == 0) { printf("Query empty.\n"); return; }
+    char *argv[] = { "find", q };
+    runCommand(2, argv);
+}
+
+void updateStudent() {
+    if (studentCount == 0) { printf("No records.\n"); return; }
+    int roll = inputIntInRange("Enter roll number to update: ", 1, 1000000000);
+    int idx = findIndexByRoll(roll);
+    if (idx < 0) { printf("No student with roll %d.\n", roll); return; }
+
+    Student *s = &students[idx];
+    printf("\nEditing Roll %d (%s)\n", s->roll, studentName(s));
+    printf("1) Update Name\n");
+    printf("2) Update Subjects & Marks\n");
+    printf("3) Cancel\n");
+    int ch = inputIntInRange("Choose: ", 1, 3);
+
+    char rollText[16];
+    snprintf(rollText, sizeof(rollText), "%d", roll);
+    if (ch == 1) {
+        printf("New name: ");
+        char buf[256];
+        safeGets(buf, sizeof(buf));
+        if (strlen(buf) == 0) { printf("Name unchanged.\n"); return; }
+        char *argv[] = { "rename", rollText, buf };
+        runCommand(3, argv);
+    } else if (ch == 2) {
+        int count = inputIntInRange("Enter number of subjects (1-10): ", 1, MAX_SUBJECTS);
+        char marks[MAX_SUBJECTS][8];
+        char *argv[2 + MAX_SUBJECTS] = { "marks", rollText };
+        for (int i = 0; i < count; ++i) {
+            char prompt[64];
+            snprintf(prompt, sizeof(prompt), "Enter marks for subject %d (0-100): ", i + 1);
+            snprintf(marks[i], sizeof(marks[i]), "%d", inputIntInRange(prompt, 0, 100));
+            argv[2 + i] = marks[i];
+        }
+        runCommand(2 + count, argv);
+    } else {
+        printf("Cancelled.\n");
+    }
+}
+
+void deleteStudent() {
+    if (studentCount == 0) { printf("No records.\n"); return; }
+    int roll = inputIntInRange("Enter roll number to delete: ", 1, 1000000000);
+    int idx = findIndexByRoll(roll);
+    if (idx < 0) { printf("No student with roll %d.\n", roll); return; }
+
+    printf("Are you sure you want to delete Roll %d (%s)? (y/n): ", students[idx].roll, studentName(&students[idx]));
+    int c = getchar(); int ch; while ((ch = getchar()) != '\n' && ch != EOF) {}
+    if (c != 'y' && c != 'Y') { printf("Cancelled.\n"); return; }
+
+    char rollText[16];
+    snprintf(rollText, sizeof(rollText), "%d", roll);
+    char *argv[] = { "delete", rollText };
+    runCommand(2, argv);
+}
+
+/* -------------------- Sorting ---------------------- */
+
+int cmpRollAsc(const void *a, const void *b) {
+    const Student *x = (const Student *)a, *y = (const Student *)b;
+    return (x->roll - y->roll);
+}
+int cmpRollDesc(const void *a, const void *b) { return -cmpRollAsc(a,b); }
+
+int cmpNameAsc(const void *a, const void *b) {
+    const Student *x = (const Student *)a, *y = (const Student *)b;
+    int c = strcmp(x->folded, y->folded);
+    return c ? c : strcmp(x->name, y->name);
+}
+int cmpNameDesc(const void *a, const void *b) { return -cmpNameAsc(a,b); }
+
+int cmpAvgAsc(const void *a, const void *b) {
+    const Student *x = (const Student *)a, *y = (const Student *)b;
+    if (x->average < y->average) return -1;
+    if (x->average > y->average) return  1;
+    return 0;
+}
+int cmpAvgDesc(const void *a, const void *b) { return -cmpAvgAsc(a,b); }
+
+// key: 'r' roll, 'n' name, 'a' average. Returns 0 for an unknown key.
+int sortRoster(char key, int desc) {
+    static const char *keyNames[] = { "roll", "name", "avg" };
+    int (*cmp)(const void *, const void *);
+    if      (key == 'r') cmp = desc ? cmpRollDesc : cmpRollAsc;
+    else if (key == 'n') { cmp = desc ? cmpNameDesc : cmpNameAsc; materializeNames(); }
+    else if (key == 'a') cmp = desc ? cmpAvgDesc : cmpAvgAsc;
+    else return 0;
+
+    double t0 = spanStart();
+    qsort(students, studentCount, sizeof(Student), cmp);
+    PROBE4(sort, keyNames[key == 'r' ? 0 : key == 'n' ? 1 : 2], desc, studentCount, nsSince(t0));
+    traceSpan("qsort", "sort", t0, "records", studentCount);
+    rosterChanged();
+    return 1;
+}
+
+// sort roll|name|avg [asc|desc]
+int cmdSort(int argc, char **argv) {
+    int desc = argc > 2 && strcasecmp(argv[2], "desc") == 0;
+    char key = strcasecmp(argv[1], "roll") == 0 ? 'r' : strcasecmp(argv[1], "name") == 0 ? 'n'
+             : strcasecmp(argv[1], "avg") == 0 ? 'a' : 0;
+    if (!sortRoster(key, desc)) { printf("Unknown sort key '%s' (roll, name, avg).\n", argv[1]); return 1; }
+    walLogSort(key, desc);
+    saveChanges();
+    printf("✅ Sorted.\n");
+    return 0;
+}
+
+// checkpoint
+int cmdCheckpoint(int argc, char **argv) {
+    (void)argc; (void)argv;
+    saveAll();
+    if (walFp) printf("✅ Checkpoint written at LSN %llu.\n", (unsigned long long)snapshotLsn);
+    else printf("✅ Saved (no write-ahead log in use).\n");
+    return 0;
+}
+
+void sortMenu() {
+    if (studentCount == 0) { printf("No records.\n"); return; }
+    printf("\nSort by:\n");
+    printf("1) Roll (Asc)\n");
+    printf("2) Roll (Desc)\n");
+    printf("3) Name (Asc)\n");
+    printf("4) Name (Desc)\n");
+    printf("5) Average (Asc)\n");
+    printf("6) Average (Desc)\n");
+    int ch = inputIntInRange("Choose: ", 1, 6);
+
+    static char *keys[] = { "roll", "name", "avg" };
+    char *argv[] = { "sort", keys[(ch - 1) / 2], (ch % 2) ? "asc" : "desc" };
+    runCommand(3, argv);
+}
+
+/* -------------------- Statistics ------------------- */
+
+// stats
+int cmdStats(int argc, char **argv) {
+    (void)argc; (void)argv;
+    if (studentCount == 0) { printf("No records.\n"); return 0; }
+
+    double t0 = spanStart();
+    float classSum = 0.0f;
+    int gradeA=0, gradeB=0, gradeC=0, gradeD=0, gradeF=0;
+    int topIdx = 0, lowIdx = 0;
+
+    for (int i = 0; i < studentCount; ++i) {
+        classSum += students[i].average;
+        if (students[i].average > students[topIdx].average) topIdx = i;
+        if (students[i].average < students[lowIdx].average) lowIdx = i;
+        switch (students[i].grade) {
+            case 'A': gradeA++; break;
+            case 'B': gradeB++; break;
+            case 'C': gradeC++; break;
+            case 'D': gradeD++; break;
+            default: gradeF++; break;
+        }
+    }
+
+    float classAvg = classSum / studentCount;
+    PROBE2(stats, studentCount, nsSince(t0));
+
+    printf("\n--- Statistics ---\n");
+    printf("Total students : %d\n", studentCount);
+    printf("Class average  : %.2f\n", classAvg);
+    printf("Topper         : Roll %d (%s) Avg %.2f\n", students[topIdx].roll, studentName(&students[topIdx]), students[topIdx].average);
+    printf("Lowest         : Roll %d (%s) Avg %.2f\n", students[lowIdx].roll, studentName(&students[lowIdx]), students[lowIdx].average);
+    printf("Grades         : A=%d, B=%d, C=%d, D=%d, F=%d\n", gradeA, gradeB, gradeC, gradeD, gradeF);
+    return 0;
+}
+
+void showStats() {
+    char *argv[] = { "stats" };
+    runCommand(1, argv);
+}
+
+/* ------------------ Term History ------------------- */
+/*
+   Append-only marks history: historyPath() is a sequence of term blocks, kept
+   next to the snapshot. Each block is written once and never modified:
+
+   [TermBlockHeader][TermDirEntry x count][payload bytes]
+
+   - header carries the term number and the class summary for that term
+   - directory is sorted by roll and holds each student's average, so
+     trend / class-average queries never touch the payload
+   - payload holds the marks: one tag byte (subjectCount, plus HIST_DELTA
+     when the marks are stored as differences from the same roll's entry
+     in the previous block) followed by zigzag varints
+   - every HIST_KEY_EVERY-th block (the first included) stores all marks
+     in full, so appending a term decodes at most that many blocks
+*/
+
+#define HIST_MAGIC 0x314D5254u   /* "TRM1" */
+#define HIST_DELTA 0x80
+#define HIST_KEY_EVERY 16
+
+static const char *historyPath() {
+    static char path[1024];
+    snprintf(path, sizeof(path), "%s.history", dataFile);
+    return path;
+}
+
+typedef struct {
+    unsigned int magic;
+    int   term;
+    int   count;
+    float classAverage;
+    int   payloadBytes;
+} TermBlockHeader;
+
+typedef struct {
+    int      roll;
+    float    average;
+    unsigned payloadOffset;
+} TermDirEntry;
+
+typedef struct {
+    int roll;
+    int subjectCount;
+    int marks[MAX_SUBJECTS];
+} TermMarks;
+
+static long termBlockSize(const TermBlockHeader *h) {
+    return (long)sizeof(*h) + (long)h->count * (long)sizeof(TermDirEntry) + h->payloadBytes;
+}
+
+static int readTermHeader(FILE *fp, TermBlockHeader *h) {
+    if (fread(h, sizeof(*h), 1, fp) != 1) return 0;
+    if (h->magic != HIST_MAGIC || h->count < 0 || h->payloadBytes < 0) return 0;
+    return 1;
+}
+
+static int putVarint(unsigned char *out, int v) {
+    unsigned u = ((unsigned)v << 1) ^ (unsigned)(v >> 31);   // zigzag
+    int n = 0;
+    while (u >= 0x80) { out[n++] = (unsigned char)(u | 0x80); u >>= 7; }
+    out[n++] = (unsigned char)u;
+    return n;
+}
+
+static int getVarint(const unsigned char *in, int avail, int *v) {
+    unsigned u = 0; int shift = 0, n = 0;
+    while (n < avail && shift < 32) {
+        unsigned char b = in[n++];
+        u |= (unsigned)(b & 0x7F) << shift;
+        if (!(b & 0x80)) { *v = (int)(u >> 1) ^ -(int)(u & 1); return n; }
+        shift += 7;
+    }
+    return 0;
+}
+
+static const TermMarks *findTermMarks(const TermMarks *arr, int n, int roll) {
+    int lo = 0, hi = n - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (arr[mid].roll == roll) return &arr[mid];
+        if (arr[mid].roll < roll) lo = mid + 1; else hi = mid - 1;
+    }
+    return NULL;
+}
+
+// Decode one payload entry; prev is the same roll's marks in the previous block (or NULL).
+static int decodeTermEntry(const unsigned char *p, int avail, const TermMarks *prev, TermMarks *out) {
+    if (avail < 1) return 0;
+    int tag = p[0], used = 1;
+    out->subjectCount = tag & 0x7F;
+    if (out->subjectCount < 1 || out->subjectCount > MAX_SUBJECTS) return 0;
+    if ((tag & HIST_DELTA) && (!prev || prev->subjectCount != out->subjectCount)) return 0;
+    for (int j = 0; j < out->subjectCount; ++j) {
+        int v, n = getVarint(p + used, avail - used, &v);
+        if (!n) return 0;
+        used += n;
+        out->marks[j] = (tag & HIST_DELTA) ? prev->marks[j] + v : v;
+    }
+    return used;
+}
+
+/*
+   Find the newest full block by a header-only walk, then decode it and
+   each later block against its predecessor, leaving the fully decoded
+   marks of the newest block in *last (sorted by roll), the number of
+   blocks in *blocks and the offset just past the last one in *validEnd.
+   Buffers come from threadArena() and are reused from block to block.
+   Only needed when appending a new term, never for queries.
+*/
+static int loadLastTermMarks(FILE *fp, int *lastTerm, TermMarks **last, int *lastCount,
+                             int *blocks, long *validEnd) {
+    TermBlockHeader h;
+    TermMarks *prev = NULL, *cur = NULL; int prevCount = 0;
+    TermDirEntry *dir = NULL;
+    unsigned char *payload = NULL;
+    size_t prevCap = 0, curCap = 0, dirCap = 0, payloadCap = 0;
+    long keyOffset = 0, size;
+    int keyBlock = 0;
+    *lastTerm = 0;
+    *blocks = 0;
+    *validEnd = 0;
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    for (long off = 0; readTermHeader(fp, &h) && off + termBlockSize(&h) <= size; off += termBlockSize(&h), ++keyBlock) {
+        if (keyBlock % HIST_KEY_EVERY == 0) { keyOffset = off; *blocks = keyBlock; }
+        if (fseek(fp, off + termBlockSize(&h), SEEK_SET) != 0) break;
+    }
+    fseek(fp, keyOffset, SEEK_SET);
+    while (readTermHeader(fp, &h)) {
+        dir = arenaGrow(threadArena(), dir, 0, &dirCap, sizeof(TermDirEntry) * h.count);
+        payload = arenaGrow(threadArena(), payload, 0, &payloadCap, h.payloadBytes);
+        cur = arenaGrow(threadArena(), cur, 0, &curCap, sizeof(TermMarks) * h.count);
+        int ok = dir && payload && cur
+              && fread(dir, sizeof(TermDirEntry), h.count, fp) == (size_t)h.count
+              && fread(payload, 1, h.payloadBytes, fp) == (size_t)h.payloadBytes;
+        for (int i = 0; ok && i < h.count; ++i) {
+            cur[i].roll = dir[i].roll;
+            unsigned off = dir[i].payloadOffset;
+            ok = off < (unsigned)h.payloadBytes
+              && decodeTermEntry(payload + off, h.payloadBytes - (int)off,
+                                 findTermMarks(prev, prevCount, dir[i].roll), &cur[i]);
+        }
+        if (!ok) break;                    // torn/corrupt tail: keep what decoded cleanly
+        TermMarks *spare = prev; size_t spareCap = prevCap;
+        prev = cur; prevCap = curCap; prevCount = h.count;
+        cur = spare; curCap = spareCap;
+        *lastTerm = h.term;
+        *validEnd = ftell(fp);
+        ++*blocks;
+    }
+    *last = prev; *lastCount = prevCount;
+    return 1;
+}
+
+static int cmpIntAsc(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Newest term number in the history (0 if none); reads block headers only.
+int lastRecordedTerm() {
+    FILE *fp = fopen(historyPath(), "rb");
+    if (!fp) return 0;
+    TermBlockHeader h;
+    int term = 0;
+    while (readTermHeader(fp, &h)) {
+        term = h.term;
+        if (fseek(fp, termBlockSize(&h) - (long)sizeof(h), SEEK_CUR) != 0) break;
+    }
+    fclose(fp);
+    return term;
+}
+
+// term TERM
+int cmdRecordTerm(int argc, char **argv) {
+    (void)argc;
+    if (studentCount == 0) { printf("No records.\n"); return 1; }
+    char *end;
+    long term = strtol(argv[1], &end, 10);
+    if (end == argv[1] || *end || term < 1 || term > 1000000000) {
+        printf("Invalid term number '%s'.\n", argv[1]);
+        return 1;
+    }
+    FILE *fp = fopen(historyPath(), "a+b");
+    if (!fp) { printf("Error: cannot open %s\n", historyPath()); return 1; }
+
+    int lastTerm; TermMarks *prev; int prevCount;
+    int blocks;
+    long validEnd;
+    loadLastTermMarks(fp, &lastTerm, &prev, &prevCount, &blocks, &validEnd);
+    if (term <= lastTerm) {
+        printf("Term must be greater than %d.\n", lastTerm);
+        fclose(fp);
+        return 1;
+    }
+
+    // directory must be sorted by roll; sort (roll, index) pairs instead of the roster
+    int *order = arenaAlloc(threadArena(), sizeof(int) * 2 * studentCount);
+    TermDirEntry *dir = arenaAlloc(threadArena(), sizeof(TermDirEntry) * studentCount);
+    unsigned char *payload = arenaAlloc(threadArena(), (size_t)studentCount * (1 + MAX_SUBJECTS * 2));
+    if (!order || !dir || !payload) {
+        printf("Error: out of memory.\n");
+        fclose(fp);
+        return 1;
+    }
+    for (int i = 0; i < studentCount; ++i) { order[2*i] = students[i].roll; order[2*i+1] = i; }
+    qsort(order, studentCount, sizeof(int) * 2, cmpIntAsc);
+
+    TermBlockHeader h = { HIST_MAGIC, (int)term, studentCount, 0.0f, 0 };
+    float classSum = 0.0f;
+    int used = 0, deltas = 0, full = blocks % HIST_KEY_EVERY == 0;
+    for (int k = 0; k < studentCount; ++k) {
+        const Student *s = &students[order[2*k+1]];
+        const TermMarks *p = full ? NULL : findTermMarks(prev, prevCount, s->roll);
+        int delta = p && p->subjectCount == s->subjectCount;
+        dir[k].roll = s->roll;
+        dir[k].average = s->average;
+        dir[k].payloadOffset = (unsigned)used;
+        payload[used++] = (unsigned char)(s->subjectCount | (delta ? HIST_DELTA : 0));
+        for (int j = 0; j < s->subjectCount; ++j)
+            used += putVarint(payload + used, delta ? s->marks[j] - p->marks[j] : s->marks[j]);
+        deltas += delta;
+        classSum += s->average;
+    }
+    h.classAverage = classSum / studentCount;
+    h.payloadBytes = used;
+
+    // readers stop at the first bad block, so a torn tail would hide this one
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    if (size > validEnd) {
+        printf("Discarding %ld byte(s) of torn history after term %d.\n", size - validEnd, lastTerm);
+#ifdef _WIN32
+        int cut = 0;
+#else
+        int cut = fflush(fp) == 0 && ftruncate(fileno(fp), (off_t)validEnd) == 0;
+#endif
+        if (!cut) {
+            printf("Error: cannot truncate %s\n", historyPath());
+            fclose(fp);
+            return 1;
+        }
+        fseek(fp, 0, SEEK_END);
+    }
+    int ok = fwrite(&h, sizeof(h), 1, fp) == 1
+          && fwrite(dir, sizeof(TermDirEntry), studentCount, fp) == (size_t)studentCount
+          && fwrite(payload, 1, used, fp) == (size_t)used;
+    ok = (fclose(fp) == 0) && ok;
+
+    if (ok) printf("✅ Recorded term %ld: %d students (%d delta-encoded, %d payload bytes).\n",
+                   term, studentCount, deltas, used);
+    else    printf("Error: failed writing %s\n", historyPath());
+    return ok ? 0 : 1;
+}
+
+// terms
+int cmdTermAverages(int argc, char **argv) {
+    (void)argc; (void)argv;
+    FILE *fp = fopen(historyPath(), "rb");
+    if (!fp) { printf("No term history yet.\n"); return 0; }
+    TermBlockHeader h;
+    int blocks = 0;
+    printf("\n%-10s  %-8s  %-13s\n", "Term", "Students", "Class Average");
+    printf("----------  --------  -------------\n");
+    // header-only walk: skip each block's directory and payload
+    while (readTermHeader(fp, &h)) {
+        printf("%-10d  %-8d  %-13.2f\n", h.term, h.count, h.classAverage);
+        blocks++;
+        if (fseek(fp, termBlockSize(&h) - (long)sizeof(h), SEEK_CUR) != 0) break;
+    }
+    fclose(fp);
+    if (!blocks) printf("No term history yet.\n");
+    return 0;
+}
+
+// trend ROLL
+int cmdRollTrend(int argc, char **argv) {
+    (void)argc;
+    int roll;
+    if (!parseRollArg(argv[1], &roll)) return 1;
+    FILE *fp = fopen(historyPath(), "rb");
+    if (!fp) { printf("No term history yet.\n"); return 0; }
+
+    TermBlockHeader h;
+    long blockStart = 0;
+    int found = 0;
+    float first = 0.0f, last = 0.0f;
+    printf("\n%-10s  %-8s  %-8s\n", "Term", "Average", "Change");
+    printf("----------  --------  --------\n");
+    while (readTermHeader(fp, &h)) {
+        // binary search the on-disk directory; payloads are never read
+        int lo = 0, hi = h.count - 1;
+        TermDirEntry e;
+        while (lo <= hi) {
+            int mid = lo + (hi - lo) / 2;
+            fseek(fp, blockStart + (long)sizeof(h) + (long)mid * (long)sizeof(e), SEEK_SET);
+            if (fread(&e, sizeof(e), 1, fp) != 1) { lo = hi + 1; break; }
+            if (e.roll == roll) {
+                if (found) printf("%-10d  %-8.2f  %+-8.2f\n", h.term, e.average, e.average - last);
+                else { printf("%-10d  %-8.2f  %-8s\n", h.term, e.average, "-"); first = e.average; }
+                last = e.average;
+                found++;
+                break;
+            }
+            if (e.roll < roll) lo = mid + 1; else hi = mid - 1;
+        }
+        blockStart += termBlockSize(&h);
+        if (fseek(fp, blockStart, SEEK_SET) != 0) break;
+    }
+    fclose(fp);
+    if (!found) printf("No history for roll %d.\n", roll);
+    else if (found > 1) printf("\nOverall change over %d terms: %+.2f\n", found, last - first);
+    return 0;
+}
+
+// history ROLL
+int cmdRollMarksHistory(int argc, char **argv) {
+    (void)argc;
+    int roll;
+    if (!parseRollArg(argv[1], &roll)) return 1;
+    FILE *fp = fopen(historyPath(), "rb");
+    if (!fp) { printf("No term history yet.\n"); return 0; }
+
+    // replay this roll's delta chain block by block
+    TermBlockHeader h;
+    TermMarks prev = {0}, cur;
+    int havePrev = 0, found = 0;
+    long blockStart = 0;
+    while (readTermHeader(fp, &h)) {
+        int lo = 0, hi = h.count - 1, hit = 0;
+        TermDirEntry e = {0};
+        while (lo <= hi) {
+            int mid = lo + (hi - lo) / 2;
+            fseek(fp, blockStart + (long)sizeof(h) + (long)mid * (long)sizeof(e), SEEK_SET);
+            if (fread(&e, sizeof(e), 1, fp) != 1) break;
+            if (e.roll == roll) { hit = 1; break; }
+            if (e.roll < roll) lo = mid + 1; else hi = mid - 1;
+        }
+        if (hit) {
+            unsigned char buf[1 + MAX_SUBJECTS * 5];
+            long at = blockStart + (long)sizeof(h) + (long)h.count * (long)sizeof(e) + (long)e.payloadOffset;
+            fseek(fp, at, SEEK_SET);
+            int avail = (int)fread(buf, 1, sizeof(buf), fp);
+            if (!decodeTermEntry(buf, avail, havePrev ? &prev : NULL, &cur)) break;
+            printf("Term %-10d  Avg %-6.2f  Marks: ", h.term, e.average);
+            for (int j = 0; j < cur.subjectCount; ++j)
+                printf("%d%s", cur.marks[j], j != cur.subjectCount - 1 ? ", " : "\n");
+            prev = cur; havePrev = 1; found++;
+        } else {
+            havePrev = 0;    // chain restarts; next entry for this roll is stored raw
+        }
+        blockStart += termBlockSize(&h);
+        if (fseek(fp, blockStart, SEEK_SET) != 0) break;
+    }
+    fclose(fp);
+    if (!found) printf("No history for roll %d.\n", roll);
+    return 0;
+}
+
+void historyMenu() {
+    printf("\nTerm History:\n");
+    printf("1) Record current marks as a new term\n");
+    printf("2) Class average by term\n");
+    printf("3) Average trend for a roll\n");
+    printf("4) Marks history for a roll\n");
+    printf("5) Back\n");
+    int ch = inputIntInRange("Choose: ", 1, 5);
+    if (ch == 5) return;
+
+    char arg[16];
+    char *argv[2] = { NULL, arg };
+    if (ch == 1) {
+        if (studentCount == 0) { printf("No records.\n"); return; }
+        int lastTerm = lastRecordedTerm();
+        char prompt[64];
+        snprintf(prompt, sizeof(prompt), "Enter term number (> %d): ", lastTerm);
+        snprintf(arg, sizeof(arg), "%d", inputIntInRange(prompt, lastTerm + 1, 1000000000));
+        argv[0] = "term";
+    } else if (ch == 2) {
+        argv[0] = "terms";
+    } else {
+        snprintf(arg, sizeof(arg), "%d", inputIntInRange("Enter roll number: ", 1, 1000000000));
+        argv[0] = (ch == 3) ? "trend" : "history";
+    }
+    runCommand(ch == 2 ? 1 : 2, argv);
+}
+
+/* ------------------ External Join ------------------ */
+/*
+   Streams an external CSV (attendance, fees, ...) with a header row and
+   joins each row against the roster on roll via the roll index.
+
+   Filters:    s.<field><op><value>  roster side (roll,name,subjects,average,grade)
+               <column><op><value>   external side, ops: = != < > <= >=
+   Projection: comma list of s.<field> and external column names
+               (default: all roster fields, then all external columns)
+
+   Roster-side filters are evaluated once per student up front, so the
+   per-row cost is one split, one hash probe and the external filters.
+   That pass runs in parallel over zone-map blocks and skips any block
+   whose zone rules out a numeric roll, subjects or average filter;
+   list --where uses the same pass with bare roster field names.
+*/
+
+#define JOIN_MAX_COLS    64
+#define JOIN_MAX_FILTERS 16
+
+enum { RF_ROLL, RF_NAME, RF_SUBJECTS, RF_MARKS, RF_AVERAGE, RF_GRADE, RF_COUNT };
+static const char *rosterFieldNames[RF_COUNT] = { "roll", "name", "subjects", "marks", "average", "grade" };
+
+typedef struct {
+    int    roster;          // 1: roster field, 0: external column
+    int    col;             // RF_* or external column index
+    char   op;              // '=', '!', '<', '>', 'l' (<=), 'g' (>=)
+    char   value[64];
+    double num;
+    int    isNum;
+} JoinFilter;
+
+typedef struct { int roster; int col; } JoinColumn;
+
+// Reads one line of any length into *buf, grown in arena a; returns length or -1 at EOF.
+static long readLine(FILE *fp, Arena *a, char **buf, size_t *cap) {
+    size_t len = 0;
+    if (!*buf) { *cap = 0; *buf = arenaGrow(a, NULL, 0, cap, 4096); if (!*buf) return -1; }
+    while (fgets(*buf + len, (int)(*cap - len), fp)) {
+        len += strlen(*buf + len);
+        if (len && (*buf)[len - 1] == '\n') break;
+        if (len + 1 < *cap) break;                      // EOF without newline
+        char *grown = arenaGrow(a, *buf, len, cap, *cap * 2);
+        if (!grown) break;
+        *buf = grown;
+    }
+    if (!len) return -1;
+    while (len && ((*buf)[len - 1] == '\n' || (*buf)[len - 1] == '\r')) (*buf)[--len] = '\0';
+    return (long)len;
+}
+
+// Splits one CSV line in place, unquoting RFC 4180 fields; returns the field count.
+static int splitFields(char *line, char **fields, int maxFields) {
+    int n = 0;
+    char *p = line;
+    while (n < maxFields) {
+        char *out = p;
+        fields[n++] = out;
+        if (*p == '"') {
+            for (++p; *p; ++p) {
+                if (*p == '"') {
+                    if (p[1] != '"') { ++p; break; }
+                    ++p;
+                }
+                *out++ = *p;
+            }
+        }
+        while (*p && *p != ',') *out++ = *p++;
+        int more = *p == ',';
+        *out = '\0';
+        if (!more) break;
+        p++;
+    }
+    return n;
+}
+
+static int parseNumber(const char *txt, double *out) {
+    char *end;
+    while (isspace((unsigned char)*txt)) txt++;
+    if (!*txt) return 0;
+    *out = strtod(txt, &end);
+    while (isspace((unsigned char)*end)) end++;
+    return *end == '\0';
+}
+
+static int rosterFieldByName(const char *name) {
+    for (int f = 0; f < RF_COUNT; ++f)
+        if (strcasecmp(name, rosterFieldNames[f]) == 0) return f;
+    return -1;
+}
+
+static int columnByName(char **header, int cols, const char *name) {
+    for (int c = 0; c < cols; ++c)
+        if (strcasecmp(header[c], name) == 0) return c;
+    return -1;
+}
+
+// Resolves "s.<field>" or "<column>" into (roster, col); returns 0 if unknown. No header: roster fields only.
+static int resolveJoinColumn(const char *name, char **header, int cols, int *roster, int *col) {
+    if (!header) {
+        *roster = 1; *col = rosterFieldByName(strncasecmp(name, "s.", 2) == 0 ? name + 2 : name);
+    } else if (strncasecmp(name, "s.", 2) == 0) {
+        *roster = 1; *col = rosterFieldByName(name + 2);
+    } else {
+        *roster = 0; *col = columnByName(header, cols, name);
+    }
+    return *col >= 0;
+}
+
+static int parseJoinFilter(const char *expr, char **header, int cols, JoinFilter *f) {
+    const char *p = expr;
+    while (*p && !strchr("=!<>", *p)) p++;
+    if (!*p || p == expr) return 0;
+
+    char name[64];
+    size_t n = (size_t)(p - expr);
+    if (n >= sizeof(name)) return 0;
+    memcpy(name, expr, n); name[n] = '\0';
+    while (n && isspace((unsigned char)name[n - 1])) name[--n] = '\0';
+
+    if      (p[0] == '!' && p[1] == '=') { f->op = '!'; p += 2; }
+    else if (p[0] == '<' && p[1] == '=') { f->op = 'l'; p += 2; }
+    else if (p[0] == '>' && p[1] == '=') { f->op = 'g'; p += 2; }
+    else if (p[0] == '=' || p[0] == '<' || p[0] == '>') { f->op = p[0]; p += 1; }
+    else return 0;
+    while (isspace((unsigned char)*p)) p++;
+
+    strncpy(f->value, p, sizeof(f->value) - 1);
+    f->value[sizeof(f->value) - 1] = '\0';
+    f->isNum = parseNumber(f->value, &f->num);
+    return resolveJoinColumn(name, header, cols, &f->roster, &f->col);
+}
+
+static int filterMatches(const JoinFilter *f, const char *text) {
+    double v;
+    int cmp;
+    if (f->isNum && parseNumber(text, &v)) cmp = (v > f->num) - (v < f->num);
+    else cmp = strcasecmp(text, f->value);
+    switch (f->op) {
+        case '=': return cmp == 0;
+        case '!': return cmp != 0;
+        case '<': return cmp < 0;
+        case '>': return cmp > 0;
+        case 'l': return cmp <= 0;
+        default:  return cmp >= 0;
+    }
+}
+
+static void formatRosterField(Student *s, int f, char *out, size_t size) {
+    switch (f) {
+        case RF_ROLL:     snprintf(out, size, "%d", s->roll); break;
+        case RF_NAME:     snprintf(out, size, "%s", studentName(s)); break;
+        case RF_SUBJECTS: snprintf(out, size, "%d", s->subjectCount); break;
+        case RF_AVERAGE:  snprintf(out, size, "%.2f", s->average); break;
+        case RF_GRADE:    snprintf(out, size, "%c", s->grade); break;
+        default: {
+            size_t used = 0;
+            out[0] = '\0';
+            for (int j = 0; j < s->subjectCount && used < size; ++j)
+                used += snprintf(out + used, size - used, j ? ";%d" : "%d", s->marks[j]);
+        }
+    }
+}
+
+typedef struct {
+    const JoinFilter *jf;
+    int count;
+    unsigned char *pass;
+    int zoned;                      // consult the zone maps
+    atomic_int skipped;
+} RosterFilter;
+
+static int zoneField(int rf) {
+    return rf == RF_ROLL ? ZONE_ROLL : rf == RF_AVERAGE ? ZONE_AVERAGE : rf == RF_SUBJECTS ? ZONE_SUBJECTS : -1;
+}
+
+static int zoneable(const JoinFilter *f) {
+    return f->roster && f->isNum && zoneField(f->col) >= 0;
+}
+
+static void filterRosterBlocks(void *ctx, int begin, int end) {
+    RosterFilter *rf = ctx;
+    for (int b = begin; b < end; ++b) {
+        int first = b * ZONE_BLOCK, last = studentCount - first < ZONE_BLOCK ? studentCount : first + ZONE_BLOCK;
+        const Zone *z = rf->zoned ? blockZone(b) : NULL;
+        int may = 1;
+        for (int k = 0; z && may && k < rf->count; ++k)
+            if (zoneable(&rf->jf[k])) may = zoneMayMatch(z, zoneField(rf->jf[k].col), rf->jf[k].op, rf->jf[k].num);
+        if (!may) {
+            memset(rf->pass + first, 0, (size_t)(last - first));
+            atomic_fetch_add_explicit(&rf->skipped, 1, memory_order_relaxed);
+            continue;
+        }
+        for (int i = first; i < last; ++i) {
+            rf->pass[i] = 1;
+            for (int k = 0; k < rf->count && rf->pass[i]; ++k) {
+                if (!rf->jf[k].roster) continue;
+                char buf[256];
+                formatRosterField(&students[i], rf->jf[k].col, buf, sizeof(buf));
+                rf->pass[i] = (unsigned char)filterMatches(&rf->jf[k], buf);
+            }
+        }
+    }
+}
+
+// Sets pass[i] for each student by the roster-side filters; returns the blocks skipped on their zone alone.
+static int filterRoster(const JoinFilter *jf, int count, unsigned char *pass) {
+    RosterFilter rf = { jf, count, pass, 0, 0 };
+    for (int k = 0; k < count; ++k)
+        if (jf[k].roster && jf[k].col == RF_NAME) materializeNames();
+    for (int k = 0; k < count && !rf.zoned; ++k)
+        if (zoneable(&jf[k])) rf.zoned = ensureZones();
+    parallelFor((studentCount + ZONE_BLOCK - 1) / ZONE_BLOCK, 4, filterRosterBlocks, &rf);
+    return atomic_load(&rf.skipped);
+}
+
+/*
+   Runs the join; filters/select may be empty. Returns 0 on success.
+   Progress and timing go to stderr so the joined stream stays clean.
+*/
+int runJoin(const char *path, const char *keyCol, const char **filters, int filterCount,
+            const char *select, FILE *out) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) { fprintf(stderr, "Error: cannot open %s\n", path); return 1; }
+    setvbuf(fp, NULL, _IOFBF, 1 << 20);
+
+    double t0 = nowSeconds();
+    char *headerLine = NULL, *line = NULL;
+    size_t headerCap = 0, lineCap = 0;
+    char *header[JOIN_MAX_COLS], *fields[JOIN_MAX_COLS];
+    JoinFilter jf[JOIN_MAX_FILTERS];
+    JoinColumn proj[JOIN_MAX_COLS * 2];
+    unsigned char *rosterPass = NULL;
+    int rc = 1, cols, key, projCount = 0;
+
+    if (readLine(fp, threadArena(), &headerLine, &headerCap) < 0) { fprintf(stderr, "Error: %s is empty\n", path); goto done; }
+    cols = splitFields(headerLine, header, JOIN_MAX_COLS);
+    key = columnByName(header, cols, keyCol && *keyCol ? keyCol : "roll");
+    if (key < 0) { fprintf(stderr, "Error: key column '%s' not found\n", keyCol ? keyCol : "roll"); goto done; }
+
+    if (filterCount > JOIN_MAX_FILTERS) filterCount = JOIN_MAX_FILTERS;
+    for (int i = 0; i < filterCount; ++i)
+        if (!parseJoinFilter(filters[i], header, cols, &jf[i])) {
+            fprintf(stderr, "Error: bad filter '%s'\n", filters[i]);
+            goto done;
+        }
+
+    if (select && *select) {
+        char list[1024];
+        strncpy(list, select, sizeof(list) - 1);
+        list[sizeof(list) - 1] = '\0';
+        for (char *tok = strtok(list, ","); tok && projCount < JOIN_MAX_COLS * 2; tok = strtok(NULL, ",")) {
+            while (isspace((unsigned char)*tok)) tok++;
+            if (!resolveJoinColumn(tok, header, cols, &proj[projCount].roster, &proj[projCount].col)) {
+                fprintf(stderr, "Error: unknown column '%s'\n", tok);
+                goto done;
+            }
+            projCount++;
+        }
+    } else {
+        for (int f = 0; f < RF_COUNT; ++f) { proj[projCount].roster = 1; proj[projCount++].col = f; }
+        for (int c = 0; c < cols; ++c)
+            if (c != key) { proj[projCount].roster = 0; proj[projCount++].col = c; }
+    }
+
+    // names are only needed if the join touches them
+    for (int k = 0; k < projCount; ++k)
+        if (proj[k].roster && proj[k].col == RF_NAME) materializeNames();
+
+    // roster-side predicates: evaluate once per student
+    rosterPass = arenaAlloc(threadArena(), studentCount ? studentCount : 1);
+    if (!rosterPass) { fprintf(stderr, "Error: out of memory\n"); goto done; }
+    filterRoster(jf, filterCount, rosterPass);
+
+    for (int k = 0; k < projCount; ++k) {
+        if (k) fputc(',', out);
+        if (proj[k].roster) fprintf(out, "s.%s", rosterFieldNames[proj[k].col]);
+        else writeCsvField(out, header[proj[k].col]);
+    }
+    fputc('\n', out);
+
+    waitIndexBuild();                                       // one lookup per row: worth the roll index
+    long rows = 0, matched = 0;
+    while (readLine(fp, threadArena(), &line, &lineCap) >= 0) {
+        rows++;
+        int n = splitFields(line, fields, JOIN_MAX_COLS);
+        if (key >= n) continue;
+        char *end;
+        long roll = strtol(fields[key], &end, 10);
+        if (end == fields[key]) continue;
+        int idx = findIndexByRoll((int)roll);
+        if (idx < 0 || !rosterPass[idx]) continue;
+
+        int pass = 1;
+        for (int k = 0; k < filterCount && pass; ++k)
+            if (!jf[k].roster) pass = jf[k].col < n && filterMatches(&jf[k], fields[jf[k].col]);
+        if (!pass) continue;
+
+        for (int k = 0; k < projCount; ++k) {
+            if (k) fputc(',', out);
+            if (proj[k].roster) {
+                char buf[256];
+                formatRosterField(&students[idx], proj[k].col, buf, sizeof(buf));
+                writeCsvField(out, buf);
+            } else if (proj[k].col < n) {
+                writeCsvField(out, fields[proj[k].col]);
+            }
+        }
+        fputc('\n', out);
+        matched++;
+    }
+    fflush(out);
+    fprintf(stderr, "Joined %ld of %ld rows from %s in %.3f s\n", matched, rows, path, nowSeconds() - t0);
+    rc = 0;
+
+done:
+    fclose(fp);
+    return rc;
+}
+
+// join FILE [--key COL] [--where EXPR]... [--select LIST] [--out FILE]
+int cmdJoin(int argc, char **argv) {
+    const char *key = "roll", *select = NULL, *outPath = NULL;
+    const char *filters[JOIN_MAX_FILTERS];
+    int filterCount = 0;
+    for (int i = 2; i < argc; i += 2) {
+        if (i + 1 >= argc) { printf("Missing value for %s.\n", argv[i]); return 1; }
+        if      (strcmp(argv[i], "--key") == 0)    key = argv[i + 1];
+        else if (strcmp(argv[i], "--select") == 0) select = argv[i + 1];
+        else if (strcmp(argv[i], "--out") == 0)    outPath = argv[i + 1];
+        else if (strcmp(argv[i], "--where") == 0 && filterCount < JOIN_MAX_FILTERS) filters[filterCount++] = argv[i + 1];
+        else { printf("Unknown join option '%s'.\n", argv[i]); return 1; }
+    }
+
+    FILE *out = stdout;
+    if (outPath && !(out = fopen(outPath, "w"))) { printf("Error: cannot write %s\n", outPath); return 1; }
+    int rc = runJoin(argv[1], key, filters, filterCount, select, out);
+    if (out != stdout) {
+        fclose(out);
+        if (rc == 0) printf("✅ Joined output written to '%s'\n", outPath);
+    }
+    return rc;
+}
+
+// list --where EXPR [--where EXPR]...
+int listWhere(int argc, char **argv) {
+    JoinFilter jf[JOIN_MAX_FILTERS];
+    int filterCount = 0;
+    for (int i = 1; i < argc; i += 2) {
+        if (strcmp(argv[i], "--where") != 0) { printf("Unknown list option '%s'.\n", argv[i]); return 1; }
+        if (i + 1 >= argc) { printf("Missing value for %s.\n", argv[i]); return 1; }
+        if (filterCount == JOIN_MAX_FILTERS) { printf("At most %d filters.\n", JOIN_MAX_FILTERS); return 1; }
+        if (!parseJoinFilter(argv[i + 1], NULL, 0, &jf[filterCount++])) { printf("Bad filter '%s'.\n", argv[i + 1]); return 1; }
+    }
+    if (studentCount == 0) { printf("No records to display.\n"); return 0; }
+
+    double t0 = nowSeconds();
+    unsigned char *pass = arenaAlloc(threadArena(), studentCount);
+    if (!pass) { printf("Error: out of memory.\n"); return 1; }
+    int blocks = (studentCount + ZONE_BLOCK - 1) / ZONE_BLOCK, skipped = filterRoster(jf, filterCount, pass);
+    double us = (nowSeconds() - t0) * 1e6;
+
+    int matched = 0;
+    for (int i = 0; i < studentCount; ++i) {
+        if (!pass[i]) continue;
+        if (!matched++) { materializeNames(); printTableHeader(); }
+        printStudentRow(&students[i]);
+    }
+    if (!matched) printf("No records match.\n");
+    printf("%d of %d record(s) matched in %.0f us; %d of %d block(s) skipped by zone maps.\n",
+           matched, studentCount, us, skipped, blocks);
+    return 0;
+}
+
+void joinMenu() {
+    if (studentCount == 0) { printf("No records.\n"); return; }
+    char path[256], key[64], select[512], outPath[256], filterText[512];
+    char *argv[2 + 2 * (3 + JOIN_MAX_FILTERS)] = { "join", path };
+    int argc = 2;
+
+    printf("External CSV file: ");
+    safeGets(path, sizeof(path));
+    if (strlen(path) == 0) { printf("Cancelled.\n"); return; }
+    printf("Key column [roll]: ");
+    safeGets(key, sizeof(key));
+    if (strlen(key)) { argv[argc++] = "--key"; argv[argc++] = key; }
+    printf("Filters, separated by ';' (e.g. s.grade=F;present<20) [none]: ");
+    safeGets(filterText, sizeof(filterText));
+    int filterCount = 0;
+    for (char *tok = strtok(filterText, ";"); tok && filterCount++ < JOIN_MAX_FILTERS; tok = strtok(NULL, ";")) {
+        argv[argc++] = "--where"; argv[argc++] = tok;
+    }
+    printf("Columns (e.g. s.roll,s.name,present) [all]: ");
+    safeGets(select, sizeof(select));
+    if (strlen(select)) { argv[argc++] = "--select"; argv[argc++] = select; }
+    printf("Output file [screen]: ");
+    safeGets(outPath, sizeof(outPath));
+    if (strlen(outPath)) { argv[argc++] = "--out"; argv[argc++] = outPath; }
+
+    printf("\n");
+    runCommand(argc, argv);
+}
+
+/* --------------- Import & Duplicates --------------- */
+/*
+   import FILE [--skip-dups] [--marks]
+   Appends students from a CSV of "name,marks" rows (marks separated by
+   ';') or rows in the students.csv layout. New rolls continue after the
+   current maximum. Each row is checked against the duplicate index,
+   which already holds the rows imported before it.
+
+   dups [--marks]
+   Groups the whole roster by normalized name (and marks) in one pass.
+*/
+
+int cmdImport(int argc, char **argv) {
+    int skipDups = 0, withMarks = 0;
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--skip-dups") == 0) skipDups = 1;
+        else if (strcmp(argv[i], "--marks") == 0) withMarks = 1;
+        else { printf("Unknown option '%s'.\n", argv[i]); return 1; }
+    }
+    FILE *fp = fopen(argv[1], "r");
+    if (!fp) { printf("Error: cannot open %s\n", argv[1]); return 1; }
+
+    char *line = NULL, *fields[8], *marks[MAX_SUBJECTS + 1];
+    size_t cap = 0;
+    long lineNo = 0;
+    int nextRoll = findMaxRoll() + 1, added = 0, flagged = 0, skipped = 0, bad = 0;
+    while (readLine(fp, threadArena(), &line, &cap) >= 0) {
+        lineNo++;
+        int n = splitFields(line, fields, 8);
+        if (n == 1 && !fields[0][0]) continue;
+        if (lineNo == 1 && (strcmp(fields[0], "name") == 0 || strcmp(fields[0], "roll") == 0)) continue;
+        const char *name = n == 6 ? fields[1] : fields[0];
+        char *markList = n == 6 ? fields[3] : n == 2 ? fields[1] : NULL;
+        int count = 0;
+        if (markList)
+            for (char *tok = strtok(markList, "; "); tok && count <= MAX_SUBJECTS; tok = strtok(NULL, "; "))
+                marks[count++] = tok;
+
+        Student s = {0};
+        strncpy(s.name, name, MAX_NAME - 1);
+        nameChanged(&s);
+        if (!s.name[0] || !markList || !parseMarksArgs(count, marks, &s)) {
+            printf("  line %ld: skipped malformed row\n", lineNo);
+            bad++;
+            continue;
+        }
+
+        int j = findDuplicate(&s, withMarks);
+        if (j >= 0) {
+            char prefix[48];
+            snprintf(prefix, sizeof(prefix), "  line %ld: ", lineNo);
+            printDuplicateNote(prefix, &s, j, withMarks);
+            flagged++;
+            if (skipDups) { skipped++; continue; }
+        }
+        if (!reserveStudents(studentCount + 1)) { printf("Roster full; stopping at line %ld.\n", lineNo); break; }
+        s.roll = nextRoll++;
+        students[studentCount++] = s;
+        studentAppended(studentCount - 1);
+        noteMutation("import", s.roll);
+        walLog(WAL_ADD, &s);
+        added++;
+    }
+    fclose(fp);
+    if (added) saveChanges();
+
+    printf("\nImported %d student(s); %d likely duplicate(s)", added, flagged);
+    if (skipDups) printf(", %d skipped", skipped);
+    printf("; %d malformed line(s).\n", bad);
+    return 0;
+}
+
+typedef struct { unsigned char *seen; int *members; int count; } DupGroup;
+
+static int collectDuplicate(int idx, void *ctx) {
+    DupGroup *g = ctx;
+    g->seen[idx] = 1;
+    g->members[g->count++] = idx;
+    return 0;
+}
+
+// dups [--marks]
+int cmdDups(int argc, char **argv) {
+    int withMarks = argc > 1 && strcmp(argv[1], "--marks") == 0;
+    if (argc > 1 && !withMarks) { printf("Unknown option '%s'.\n", argv[1]); return 1; }
+    Arena *a = threadArena();
+    DupGroup g = { arenaAlloc(a, studentCount + 1), arenaAlloc(a, sizeof(int) * (studentCount + 1)), 0 };
+    if (!g.seen || !g.members) { printf("Error: out of memory.\n"); return 1; }
+    memset(g.seen, 0, studentCount + 1);
+
+    int groups = 0, involved = 0;
+    for (int i = 0; i < studentCount; ++i) {
+        if (g.seen[i]) continue;
+        g.count = 0;
+        if (forEachDuplicate(&students[i], i, withMarks, collectDuplicate, &g) < 0) {
+            printf("Error: out of memory.\n");
+            return 1;
+        }
+        if (!g.count) continue;
+        if (!groups) printf("Likely duplicates (same name%s):\n", withMarks ? " and marks" : "");
+        printf("\nGroup %d:\n", ++groups);
+        printTableHeader();
+        printStudentRow(&students[i]);
+        for (int k = 0; k < g.count; ++k) printStudentRow(&students[g.members[k]]);
+        involved += g.count + 1;
+    }
+    if (!groups) printf("No likely duplicates found.\n");
+    else printf("\n%d group(s), %d record(s) involved.\n", groups, involved);
+    return 0;
+}
+
+void importMenu() {
+    printf("\nImport & Duplicates:\n");
+    printf("1) Import students from CSV\n");
+    printf("2) Duplicate report\n");
+    printf("3) Back\n");
+    int ch = inputIntInRange("Choose: ", 1, 3);
+    if (ch == 3) return;
+
+    char path[256], yn[8];
+    char *argv[4] = { NULL, path };
+    int argc = 1;
+    if (ch == 1) {
+        printf("CSV file (name,marks per row): ");
+        safeGets(path, sizeof(path));
+        if (strlen(path) == 0) { printf("Cancelled.\n"); return; }
+        argv[0] = "import";
+        argc = 2;
+        printf("Skip likely duplicates? (y/n): ");
+        safeGets(yn, sizeof(yn));
+        if (yn[0] == 'y' || yn[0] == 'Y') argv[argc++] = "--skip-dups";
+    } else {
+        argv[0] = "dups";
+        printf("Require identical marks too? (y/n): ");
+        safeGets(yn, sizeof(yn));
+        if (yn[0] == 'y' || yn[0] == 'Y') argv[argc++] = "--marks";
+    }
+    printf("\n");
+    runCommand(argc, argv);
+}
+
+/* -------------------- Export Report ---------------- */
+
+// report
+int cmdReport(int argc, char **argv) {
+    (void)argc; (void)argv;
+    if (studentCount == 0) { printf("No records to export.\n"); return 0; }
+    FILE *fp = fopen(REPORT_FILE, "w");
+    if (!fp) { printf("Error: cannot write report.\n"); return 1; }
+    materializeNames();
+
+    fprintf(fp, "==============================================\n");
+    fprintf(fp, "          Student Management Report           \n");
+    fprintf(fp, "==============================================\n\n");
+
+    fprintf(fp, "%-6s  %-25s  %-8s  %-8s  %-5s\n", "Roll", "Name", "Subjects", "Average", "Grade");
+    fprintf(fp, "------  -------------------------  --------  --------  -----\n");
+    for (int i = 0; i < studentCount; ++i) {
+        fprintf(fp, "%-6d  ", students[i].roll);
+        printPadded(fp, students[i].name, 25);
+        fprintf(fp, "  %-8d  %-8.2f  %-5c\n", students[i].subjectCount, students[i].average, students[i].grade);
+    }
+
+    // stats
+    float classSum = 0.0f; int topIdx = 0, lowIdx = 0;
+    for (int i = 0; i < studentCount; ++i) {
+        classSum += students[i].average;
+        if (students[i].average > students[topIdx].average) topIdx = i;
+        if (students[i].average < students[lowIdx].average) lowIdx = i;
+    }
+    float classAvg = classSum / studentCount;
+
+    fprintf(fp, "\n--- Summary ---\n");
+    fprintf(fp, "Total students : %d\n", studentCount);
+    fprintf(fp, "Class average  : %.2f\n", classAvg);
+    fprintf(fp, "Topper         : Roll %d (%s) Avg %.2f\n", students[topIdx].roll, students[topIdx].name, students[topIdx].average);
+    fprintf(fp, "Lowest         : Roll %d (%s) Avg %.2f\n", students[lowIdx].roll, students[lowIdx].name, students[lowIdx].average);
+
+    fclose(fp);
+    printf("✅ Exported report to '%s'\n", REPORT_FILE);
+    return 0;
+}
+
+void exportReport() {
+    char *argv[] = { "report" };
+    runCommand(1, argv);
+}
+
+/* ------------------- Arrow Export ------------------ */
+/*
+   The roster as Apache Arrow columns, for pandas, DuckDB, polars or any
+   other Arrow consumer, without depending on an Arrow library: the C
+   Data Interface structs below are the ABI itself, guarded so that the
+   official arrow/c/abi.h may be included instead.
+
+   exportRosterSchema() and exportRosterArray() describe the roster as a
+   struct array with one child per column, none of them nullable:
+
+       roll int32, name utf8, subjectCount int32, marks list<int32>,
+       average float32, grade utf8
+
+   Records are stored row by row, so the export gathers the columns once,
+   in parallel, into one block of 64-byte aligned buffers; consumers then
+   read those buffers in place. The block is freed when the last array
+   using it is released (from any thread), and later roster changes do
+   not touch it.
+
+   arrow FILE writes the same buffers as an Arrow IPC file (Feather v2):
+   a schema and one record batch, with the flatbuffer metadata encoded
+   here. pyarrow.ipc.open_file() over a memory map, DuckDB and polars read
+   it without copying.
+*/
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+    const char *format;
+    const char *name;
+    const char *metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema **children;
+    struct ArrowSchema *dictionary;
+    void (*release)(struct ArrowSchema *);
+    void *private_data;
+};
+
+struct ArrowArray {
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void **buffers;
+    struct ArrowArray **children;
+    struct ArrowArray *dictionary;
+    void (*release)(struct ArrowArray *);
+    void *private_data;
+};
+
+#endif  // ARROW_C_DATA_INTERFACE
+
+// Columns in RF_* order.
+static const char *const arrowColumnNames[RF_COUNT] = { "roll", "name", "subjectCount", "marks", "average", "grade" };
+static const char *const arrowFormats[RF_COUNT] = { "i", "u", "i", "+l", "f", "u" };
+
+typedef struct {
+    struct ArrowSchema *childPtrs[RF_COUNT];
+    struct ArrowSchema child[RF_COUNT];
+} ArrowSchemaNode;
+
+static void releaseArrowSchema(struct ArrowSchema *s) {
+    for (int64_t k = 0; k < s->n_children; ++k)
+        if (s->children[k]->release) s->children[k]->release(s->children[k]);
+    free(s->private_data);
+    s->release = NULL;
+}
+
+static int arrowSchemaNode(struct ArrowSchema *s, const char *format, const char *name, int children) {
+    ArrowSchemaNode *node = calloc(1, sizeof(*node));  // children start out released
+    if (!node) return 0;
+    for (int k = 0; k < children; ++k) node->childPtrs[k] = &node->child[k];
+    *s = (struct ArrowSchema){ format, name, NULL, 0, children, node->childPtrs, NULL, releaseArrowSchema, node };
+    return 1;
+}
+
+// Describes the columns exportRosterArray() produces. 0: out of memory.
+int exportRosterSchema(struct ArrowSchema *out) {
+    int ok = arrowSchemaNode(out, "+s", "", RF_COUNT);
+    for (int f = 0; ok && f < RF_COUNT; ++f)
+        ok = arrowSchemaNode(out->children[f], arrowFormats[f], arrowColumnNames[f], f == RF_MARKS)
+          && (f != RF_MARKS || arrowSchemaNode(out->children[f]->children[0], "i", "item", 0));
+    if (!ok && out->release) out->release(out);
+    return ok;
+}
+
+typedef struct {
+    atomic_int refs;                // arrays still reading the buffers
+    void *buffers;                  // bigAlloc'd
+} ArrowBlock;
+
+typedef struct {
+    ArrowBlock *block;
+    const void *buffers[3];
+    struct ArrowArray *childPtrs[RF_COUNT];
+    struct ArrowArray child[RF_COUNT];
+} ArrowArrayNode;
+
+static void releaseArrowArray(struct ArrowArray *a) {
+    ArrowArrayNode *node = a->private_data;
+    for (int64_t k = 0; k < a->n_children; ++k)
+        if (a->children[k]->release) a->children[k]->release(a->children[k]);
+    if (atomic_fetch_sub(&node->block->refs, 1) == 1) {
+        bigFree(node->block->buffers);
+        free(node->block);
+    }
+    free(node);
+    a->release = NULL;
+}
+
+// An array with no nulls over buffers in block: validity (absent), then b1 and b2.
+static int arrowArrayNode(struct ArrowArray *a, ArrowBlock *block, int64_t length, int buffers,
+                          const void *b1, const void *b2, int children) {
+    ArrowArrayNode *node = calloc(1, sizeof(*node));
+    if (!node) return 0;
+    node->block = block;
+    atomic_fetch_add(&block->refs, 1);
+    node->buffers[1] = b1;
+    node->buffers[2] = b2;
+    for (int k = 0; k < children; ++k) node->childPtrs[k] = &node->child[k];
+    *a = (struct ArrowArray){ length, 0, 0, buffers, children, node->buffers, node->childPtrs, NULL, releaseArrowArray, node };
+    return 1;
+}
+
+typedef struct {
+    int32_t *roll, *nameOffsets, *subjects, *markOffsets, *marks, *gradeOffsets;
+    float *average;
+    char *names, *grades;
+} RosterColumns;
+
+static void fillRosterColumns(void *ctx, int begin, int end) {
+    const RosterColumns *c = ctx;
+    for (int i = begin; i < end; ++i) {
+        const Student *s = &students[i];
+        c->roll[i] = s->roll;
+        c->subjects[i] = s->subjectCount;
+        c->average[i] = s->average;
+        c->grades[i] = s->grade;
+        c->gradeOffsets[i + 1] = i + 1;
+        memcpy(c->names + c->nameOffsets[i], s->name, (size_t)(c->nameOffsets[i + 1] - c->nameOffsets[i]));
+        memcpy(c->marks + c->markOffsets[i], s->marks, sizeof(int32_t) * (size_t)s->subjectCount);
+    }
+}
+
+#define ARROW_ALIGN(bytes) (((size_t)(bytes) + 63) & ~(size_t)63)
 
-void exportReport() {
-    if (studentCount == 0) { printf("No records to export.\n"); return; }
-    FILE *fp = fopen(REPORT_FILE, "w");
-    if (!fp) { printf("Error: cannot write report.\n"); return; }
+// Hands out the next 64-byte aligned buffer of the block.
+static void *carveBuffer(char **next, size_t bytes) {
+    void *p = *next;
+    *next += ARROW_ALIGN(bytes);
+    return p;
+}
 
-    fprintf(fp, "==============================================\n");
-    fprintf(fp, "          Student Management Report           \n");
-    fprintf(fp, "==============================================\n\n");
+// Copies the roster into Arrow columns. 0: out of memory, or names past the 2 GiB utf8 limit.
+int exportRosterArray(struct ArrowArray *out) {
+    materializeNames();
+    double t0 = spanStart();
+    size_t n = (size_t)studentCount;
+    int64_t nameBytes = 0, markCount = 0;
+    for (size_t i = 0; i < n; ++i) {
+        nameBytes += (int64_t)strlen(students[i].name);
+        markCount += students[i].subjectCount;
+    }
+    if (nameBytes > INT32_MAX) return 0;
 
-    fprintf(fp, "%-6s  %-25s  %-8s  %-8s  %-5s\n", "Roll", "Name", "Subjects", "Average", "Grade");
-    fprintf(fp, "------  -------------------------  --------  --------  -----\n");
-    for (int i = 0; i < studentCount; ++i) {
-        fprintf(fp, "%-6d  %-25.25s  %-8d  %-8.2f  %-5c\n",
-                students[i].roll, students[i].name, students[i].subjectCount, students[i].average, students[i].grade);
+    size_t total = 4 * ARROW_ALIGN(sizeof(int32_t) * n) + 3 * ARROW_ALIGN(sizeof(int32_t) * (n + 1))
+                 + ARROW_ALIGN(sizeof(int32_t) * (size_t)markCount) + ARROW_ALIGN((size_t)nameBytes) + ARROW_ALIGN(n);
+    ArrowBlock *block = calloc(1, sizeof(*block));
+    char *next = block ? bigAlloc(total) : NULL;
+    if (!next) { free(block); return 0; }
+    block->buffers = next;
+    RosterColumns c;
+    c.roll = carveBuffer(&next, sizeof(int32_t) * n);
+    c.nameOffsets = carveBuffer(&next, sizeof(int32_t) * (n + 1));
+    c.names = carveBuffer(&next, (size_t)nameBytes);
+    c.subjects = carveBuffer(&next, sizeof(int32_t) * n);
+    c.markOffsets = carveBuffer(&next, sizeof(int32_t) * (n + 1));
+    c.marks = carveBuffer(&next, sizeof(int32_t) * (size_t)markCount);
+    c.average = carveBuffer(&next, sizeof(float) * n);
+    c.gradeOffsets = carveBuffer(&next, sizeof(int32_t) * (n + 1));
+    c.grades = carveBuffer(&next, n);
+
+    c.nameOffsets[0] = c.markOffsets[0] = c.gradeOffsets[0] = 0;
+    for (size_t i = 0; i < n; ++i) {
+        c.nameOffsets[i + 1] = c.nameOffsets[i] + (int32_t)strlen(students[i].name);
+        c.markOffsets[i + 1] = c.markOffsets[i] + students[i].subjectCount;
     }
+    parallelFor((int)n, 4096, fillRosterColumns, &c);
 
-    // stats
-    float classSum = 0.0f; int topIdx = 0, lowIdx = 0;
-    for (int i = 0; i < studentCount; ++i) {
-        classSum += students[i].average;
-        if (students[i].average > students[topIdx].average) topIdx = i;
-        if (students[i].average < students[lowIdx].average) lowIdx = i;
+    int64_t len = (int64_t)n;
+    int ok = arrowArrayNode(out, block, len, 1, NULL, NULL, RF_COUNT);
+    if (!ok) { bigFree(block->buffers); free(block); return 0; }
+    ok = arrowArrayNode(out->children[RF_ROLL], block, len, 2, c.roll, NULL, 0)
+      && arrowArrayNode(out->children[RF_NAME], block, len, 3, c.nameOffsets, c.names, 0)
+      && arrowArrayNode(out->children[RF_SUBJECTS], block, len, 2, c.subjects, NULL, 0)
+      && arrowArrayNode(out->children[RF_MARKS], block, len, 2, c.markOffsets, NULL, 1)
+      && arrowArrayNode(out->children[RF_MARKS]->children[0], block, markCount, 2, c.marks, NULL, 0)
+      && arrowArrayNode(out->children[RF_AVERAGE], block, len, 2, c.average, NULL, 0)
+      && arrowArrayNode(out->children[RF_GRADE], block, len, 3, c.gradeOffsets, c.grades, 0);
+    if (!ok) { out->release(out); return 0; }           // frees the block with the last node
+    traceSpan("arrow export", "command", t0, "records", studentCount);
+    return 1;
+}
+
+/*
+   Arrow IPC file writer. Flatbuffers are normally built back to front;
+   this builder writes front to back instead, parent before children, so
+   every offset (which must point forward) is patched in once its target
+   is written. Each table's vtable sits right before it.
+*/
+
+typedef struct {
+    unsigned char *p;
+    size_t len, cap;
+    int failed;                     // out of memory: writes are dropped
+} Fb;
+
+// Appends `bytes` zeroed bytes at a position p with (p + skew) % align == 0; returns p.
+static size_t fbReserve(Fb *b, size_t bytes, size_t align, size_t skew) {
+    size_t at = (b->len + skew + align - 1) / align * align - skew;
+    if (at < b->len) at += align;
+    if (at + bytes > b->cap && !b->failed) {
+        size_t cap = b->cap ? b->cap : 1024;
+        while (cap < at + bytes) cap *= 2;
+        unsigned char *p = realloc(b->p, cap);
+        if (!p) b->failed = 1;
+        else { b->p = p; b->cap = cap; }
     }
-    float classAvg = classSum / studentCount;
+    if (!b->failed) memset(b->p + b->len, 0, at + bytes - b->len);
+    b->len = at + bytes;
+    return at;
+}
 
-    fprintf(fp, "\n--- Summary ---\n");
-    fprintf(fp, "Total students : %d\n", studentCount);
-    fprintf(fp, "Class average  : %.2f\n", classAvg);
-    fprintf(fp, "Topper         : Roll %d (%s) Avg %.2f\n", students[topIdx].roll, students[topIdx].name, students[topIdx].average);
-    fprintf(fp, "Lowest         : Roll %d (%s) Avg %.2f\n", students[lowIdx].roll, students[lowIdx].name, students[lowIdx].average);
+static void fbPut(Fb *b, size_t at, const void *v, size_t bytes) {
+    if (!b->failed) memcpy(b->p + at, v, bytes);
+}
+
+// Points the offset field at `at` to `target`, written after it.
+static void fbRef(Fb *b, size_t at, size_t target) {
+    uint32_t off = (uint32_t)(target - at);
+    fbPut(b, at, &off, 4);
+}
+
+typedef struct { Fb *b; size_t vtable, start; } FbTable;
+
+static FbTable fbTable(Fb *b, int slots) {
+    FbTable t = { b, fbReserve(b, 4 + 2 * (size_t)slots, 2, 0), 0 };
+    uint16_t vsize = (uint16_t)(4 + 2 * slots);
+    fbPut(b, t.vtable, &vsize, 2);
+    t.start = fbReserve(b, 4, 4, 0);
+    int32_t back = (int32_t)(t.start - t.vtable);
+    fbPut(b, t.start, &back, 4);
+    return t;
+}
+
+// Adds a scalar field, or an offset to patch when v is NULL; returns its position.
+static size_t fbField(FbTable *t, int slot, const void *v, size_t bytes) {
+    size_t at = fbReserve(t->b, bytes, bytes, 0);
+    uint16_t rel = (uint16_t)(at - t->start);
+    fbPut(t->b, t->vtable + 4 + 2 * (size_t)slot, &rel, 2);
+    if (v) fbPut(t->b, at, v, bytes);
+    return at;
+}
+
+static void fbEnd(FbTable *t) {
+    uint16_t size = (uint16_t)(t->b->len - t->start);
+    fbPut(t->b, t->vtable + 2, &size, 2);
+}
+
+static size_t fbString(Fb *b, const char *s) {
+    uint32_t n = (uint32_t)strlen(s);
+    size_t at = fbReserve(b, 4 + n + 1, 4, 0);
+    fbPut(b, at, &n, 4);
+    fbPut(b, at + 4, s, n);
+    return at;
+}
+
+// A vector of n elements of `size` bytes, aligned to `align`; elems NULL leaves them to patch.
+static size_t fbVector(Fb *b, uint32_t n, size_t size, size_t align, const void *elems) {
+    size_t at = fbReserve(b, 4 + n * size, align, 4);
+    fbPut(b, at, &n, 4);
+    if (elems) fbPut(b, at + 4, elems, n * size);
+    return at;
+}
+
+// Schema.fbs / Message.fbs constants.
+enum { FB_TYPE_INT = 2, FB_TYPE_FLOAT = 3, FB_TYPE_UTF8 = 5, FB_TYPE_LIST = 12, FB_TYPE_STRUCT = 13 };
+enum { FB_MESSAGE_SCHEMA = 1, FB_MESSAGE_RECORD_BATCH = 3 };
+#define FB_METADATA_V5 4
+
+static int arrowTypeTag(const char *format) {
+    if (strcmp(format, "i") == 0)  return FB_TYPE_INT;
+    if (strcmp(format, "f") == 0)  return FB_TYPE_FLOAT;
+    if (strcmp(format, "u") == 0)  return FB_TYPE_UTF8;
+    if (strcmp(format, "+l") == 0) return FB_TYPE_LIST;
+    if (strcmp(format, "+s") == 0) return FB_TYPE_STRUCT;
+    return 0;                       // not produced by exportRosterSchema()
+}
+
+static size_t fbArrowFields(Fb *b, const struct ArrowSchema *parent);
+
+static size_t fbArrowField(Fb *b, const struct ArrowSchema *s) {
+    FbTable t = fbTable(b, 6);
+    uint8_t nullable = (s->flags & ARROW_FLAG_NULLABLE) != 0, tag = (uint8_t)arrowTypeTag(s->format);
+    size_t name = fbField(&t, 0, NULL, 4);
+    fbField(&t, 1, &nullable, 1);
+    fbField(&t, 2, &tag, 1);
+    size_t type = fbField(&t, 3, NULL, 4);
+    size_t children = fbField(&t, 5, NULL, 4);
+    fbEnd(&t);
+    fbRef(b, name, fbString(b, s->name ? s->name : ""));
+    FbTable ty = fbTable(b, 2);
+    if (tag == FB_TYPE_INT) {
+        int32_t bits = 32;
+        uint8_t isSigned = 1;
+        fbField(&ty, 0, &bits, 4);
+        fbField(&ty, 1, &isSigned, 1);
+    } else if (tag == FB_TYPE_FLOAT) {
+        int16_t single = 1;
+        fbField(&ty, 0, &single, 2);
+    }
+    fbEnd(&ty);
+    fbRef(b, type, ty.start);
+    fbRef(b, children, fbArrowFields(b, s));
+    return t.start;
+}
+
+static size_t fbArrowFields(Fb *b, const struct ArrowSchema *parent) {
+    size_t vec = fbVector(b, (uint32_t)parent->n_children, 4, 4, NULL);
+    for (int64_t k = 0; k < parent->n_children; ++k)
+        fbRef(b, vec + 4 + 4 * (size_t)k, fbArrowField(b, parent->children[k]));
+    return vec;
+}
+
+static size_t fbArrowSchema(Fb *b, const struct ArrowSchema *s) {
+    FbTable t = fbTable(b, 2);
+    int16_t little = 0;
+    fbField(&t, 0, &little, 2);
+    size_t fields = fbField(&t, 1, NULL, 4);
+    fbEnd(&t);
+    fbRef(b, fields, fbArrowFields(b, s));
+    return t.start;
+}
+
+// Root Message table; returns the header offset to patch.
+static size_t fbMessage(Fb *b, uint8_t type, int64_t bodyLength) {
+    size_t root = fbReserve(b, 4, 4, 0);
+    FbTable t = fbTable(b, 4);
+    int16_t version = FB_METADATA_V5;
+    fbField(&t, 0, &version, 2);
+    fbField(&t, 1, &type, 1);
+    size_t header = fbField(&t, 2, NULL, 4);
+    fbField(&t, 3, &bodyLength, 8);
+    fbEnd(&t);
+    fbRef(b, root, t.start);
+    return header;
+}
+
+#define ARROW_IPC_NODES 32
+
+// Where each buffer of a record batch goes in its body.
+typedef struct {
+    int64_t node[ARROW_IPC_NODES][2];           // FieldNode: length, null count
+    int64_t buffer[ARROW_IPC_NODES * 3][2];     // Buffer: offset, length
+    const void *data[ARROW_IPC_NODES * 3];
+    int nodes, buffers;
+    int64_t body;
+} ArrowBatchLayout;
+
+// Pre-order, as the IPC format lists them. Handles the arrays exportRosterArray() produces.
+static int layoutArrowArray(ArrowBatchLayout *l, const struct ArrowSchema *s, const struct ArrowArray *a) {
+    int tag = arrowTypeTag(s->format);
+    if (!tag || l->nodes == ARROW_IPC_NODES || a->offset || a->null_count || a->n_buffers > 3) return 0;
+    l->node[l->nodes][0] = a->length;
+    l->node[l->nodes++][1] = 0;
+    int64_t bytes[3] = { 0 };                   // no validity bitmap: nothing is null
+    if (tag == FB_TYPE_INT || tag == FB_TYPE_FLOAT) bytes[1] = 4 * a->length;
+    if (tag == FB_TYPE_UTF8 || tag == FB_TYPE_LIST) bytes[1] = 4 * (a->length + 1);
+    if (tag == FB_TYPE_UTF8) bytes[2] = ((const int32_t *)a->buffers[1])[a->length];
+    for (int k = 0; k < a->n_buffers; ++k) {
+        l->buffer[l->buffers][0] = l->body;
+        l->buffer[l->buffers][1] = bytes[k];
+        l->data[l->buffers++] = a->buffers[k];
+        l->body += (bytes[k] + 7) & ~(int64_t)7;
+    }
+    for (int64_t k = 0; k < a->n_children; ++k)
+        if (!layoutArrowArray(l, s->children[k], a->children[k])) return 0;
+    return 1;
+}
+
+// Writes one encapsulated message: continuation, metadata size, metadata padded to 8. Returns its length.
+static int64_t writeArrowMessage(FILE *fp, const Fb *b) {
+    static const char pad[8];
+    uint32_t cont = 0xFFFFFFFFu;
+    int32_t size = (int32_t)((b->len + 7) & ~(size_t)7);
+    if (fwrite(&cont, 4, 1, fp) != 1 || fwrite(&size, 4, 1, fp) != 1 || fwrite(b->p, 1, b->len, fp) != b->len
+        || fwrite(pad, 1, (size_t)size - b->len, fp) != (size_t)size - b->len) return -1;
+    return 8 + (int64_t)size;
+}
+
+/*
+   Writes schema s and struct array a (from exportRosterSchema/Array) as
+   an Arrow IPC file holding one record batch, straight from the
+   exported buffers. Returns the file size, or -1.
+*/
+long long writeArrowFile(const char *path, const struct ArrowSchema *s, const struct ArrowArray *a) {
+    static const char magic[8] = "ARROW1", pad[8];
+    ArrowBatchLayout *l = calloc(1, sizeof(*l));
+    if (!l) return -1;
+    for (int64_t k = 0; k < a->n_children; ++k)
+        if (!layoutArrowArray(l, s->children[k], a->children[k])) { free(l); return -1; }
+
+    Fb schemaMsg = {0}, batchMsg = {0}, footer = {0};
+    size_t schemaHeader = fbMessage(&schemaMsg, FB_MESSAGE_SCHEMA, 0);
+    fbRef(&schemaMsg, schemaHeader, fbArrowSchema(&schemaMsg, s));
+
+    size_t header = fbMessage(&batchMsg, FB_MESSAGE_RECORD_BATCH, l->body);
+    FbTable rb = fbTable(&batchMsg, 3);
+    fbField(&rb, 0, &a->length, 8);
+    size_t nodes = fbField(&rb, 1, NULL, 4), buffers = fbField(&rb, 2, NULL, 4);
+    fbEnd(&rb);
+    fbRef(&batchMsg, header, rb.start);
+    fbRef(&batchMsg, nodes, fbVector(&batchMsg, (uint32_t)l->nodes, 16, 8, l->node));
+    fbRef(&batchMsg, buffers, fbVector(&batchMsg, (uint32_t)l->buffers, 16, 8, l->buffer));
+
+    FILE *fp = fopen(path, "wb");
+    int ok = fp && !schemaMsg.failed && !batchMsg.failed && fwrite(magic, 1, 8, fp) == 8;
+    int64_t schemaLen = ok ? writeArrowMessage(fp, &schemaMsg) : -1;
+    int64_t batchAt = 8 + schemaLen, batchLen = schemaLen > 0 ? writeArrowMessage(fp, &batchMsg) : -1;
+    ok = batchLen > 0;
+    for (int k = 0; ok && k < l->buffers; ++k) {
+        size_t bytes = (size_t)l->buffer[k][1];
+        if (!bytes) continue;                   // absent validity bitmaps
+        ok = fwrite(l->data[k], 1, bytes, fp) == bytes && fwrite(pad, 1, (8 - bytes % 8) % 8, fp) == (8 - bytes % 8) % 8;
+    }
+    uint32_t eos[2] = { 0xFFFFFFFFu, 0 };
+    ok = ok && fwrite(eos, 4, 2, fp) == 2;
+
+    // Footer: the schema again, plus where the record batch is.
+    struct { int64_t offset; int32_t metaDataLength, pad; int64_t bodyLength; } block = { batchAt, (int32_t)batchLen, 0, l->body };
+    size_t root = fbReserve(&footer, 4, 4, 0);
+    FbTable ft = fbTable(&footer, 4);
+    int16_t version = FB_METADATA_V5;
+    fbField(&ft, 0, &version, 2);
+    size_t schema = fbField(&ft, 1, NULL, 4), dicts = fbField(&ft, 2, NULL, 4), batches = fbField(&ft, 3, NULL, 4);
+    fbEnd(&ft);
+    fbRef(&footer, root, ft.start);
+    fbRef(&footer, schema, fbArrowSchema(&footer, s));
+    fbRef(&footer, dicts, fbVector(&footer, 0, 24, 8, NULL));
+    fbRef(&footer, batches, fbVector(&footer, 1, 24, 8, &block));
+    fbReserve(&footer, 0, 8, 0);
+    int32_t footerLen = (int32_t)footer.len;
+    ok = ok && !footer.failed && fwrite(footer.p, 1, footer.len, fp) == footer.len
+       && fwrite(&footerLen, 4, 1, fp) == 1 && fwrite(magic, 1, 6, fp) == 6;
+    long long bytes = ok ? (long long)ftell(fp) : -1;
+    if (fp && fclose(fp) != 0) bytes = -1;
+    if (bytes < 0) remove(path);
+    free(schemaMsg.p); free(batchMsg.p); free(footer.p);
+    free(l);
+    return bytes;
+}
+
+// arrow FILE
+int cmdArrow(int argc, char **argv) {
+    (void)argc;
+    double t0 = nowSeconds();
+    struct ArrowSchema schema;
+    struct ArrowArray array;
+    if (!exportRosterSchema(&schema)) { printf("Error: out of memory.\n"); return 1; }
+    if (!exportRosterArray(&array)) { schema.release(&schema); printf("Error: out of memory.\n"); return 1; }
+    long long bytes = writeArrowFile(argv[1], &schema, &array);
+    array.release(&array);
+    schema.release(&schema);
+    if (bytes < 0) { printf("Error: cannot write %s\n", argv[1]); return 1; }
+    printf("✅ Exported %d record(s) to '%s' (Arrow IPC, %lld bytes) in %.3f s\n",
+           studentCount, argv[1], bytes, nowSeconds() - t0);
+    return 0;
+}
+
+/* ---------------- Metrics Exposition --------------- */
+/*
+   Writes all metrics in Prometheus text format for node-exporter's
+   textfile collector. The file is written to FILE.tmp and renamed over
+   FILE, so the collector never sees a partial scrape. runCommand()
+   refreshes it when --metrics-interval seconds have passed, and it is
+   written once more at exit.
+*/
+
+static const char *metricsPath = NULL;
+static double metricsInterval = 10.0;
+static double metricsLastWrite = 0.0;
+static double processStart = 0.0;
+
+static void writeFamily(FILE *fp, const char *name, const char *help, const char *labelName,
+                        const MetricFamily *f, int histogram) {
+    if (!f->used) return;
+    fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, histogram ? "histogram" : "counter");
+    for (int i = 0; i < f->used; ++i) {
+        const MetricSeries *m = &f->s[i];
+        if (!histogram) { fprintf(fp, "%s{%s=\"%s\"} %ld\n", name, labelName, m->label, m->count); continue; }
+        long cumulative = 0;
+        for (int b = 0; b < LATENCY_BUCKETS; ++b) {
+            cumulative += m->buckets[b];
+            if (b < LATENCY_BUCKETS - 1)
+                fprintf(fp, "%s_bucket{%s=\"%s\",le=\"%g\"} %ld\n", name, labelName, m->label, latencyBounds[b], cumulative);
+            else
+                fprintf(fp, "%s_bucket{%s=\"%s\",le=\"+Inf\"} %ld\n", name, labelName, m->label, cumulative);
+        }
+        fprintf(fp, "%s_sum{%s=\"%s\"} %.9f\n", name, labelName, m->label, m->seconds);
+        fprintf(fp, "%s_count{%s=\"%s\"} %ld\n", name, labelName, m->label, m->count);
+    }
+}
+
+static void writeScalar(FILE *fp, const char *name, const char *type, const char *help, double value) {
+    fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n%s %.15g\n", name, help, name, type, name, value);
+}
+
+static size_t arenaBytes(const Arena *a) {
+    size_t n = 0;
+    for (const ArenaBlock *b = a->first; b; b = b->next) n += sizeof(ArenaBlock) + b->size;
+    return n;
+}
+
+int writeMetrics() {
+    if (!metricsPath) return 1;
+    char tmp[1024];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", metricsPath);
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) return 0;
+
+    writeScalar(fp, "sms_start_time_seconds", "gauge", "Process start time, seconds since the epoch.", processStart);
+    writeScalar(fp, "sms_records", "gauge", "Records currently in the roster.", studentCount);
+    writeScalar(fp, "sms_loads_total", "counter", "Roster loads.", metrics.loads);
+    writeScalar(fp, "sms_records_loaded_total", "counter", "Records read by roster loads.", metrics.recordsLoaded);
+    writeScalar(fp, "sms_load_bytes_total", "counter", "Bytes read by roster loads.", metrics.bytesRead);
+    writeScalar(fp, "sms_load_seconds_total", "counter", "Time spent loading the roster.", metrics.loadSeconds);
+    writeScalar(fp, "sms_saves_total", "counter", "Roster saves.", metrics.saves);
+    writeScalar(fp, "sms_save_bytes_total", "counter", "Bytes written by roster saves.", metrics.bytesWritten);
+    writeScalar(fp, "sms_save_seconds_total", "counter", "Time spent saving the roster.", metrics.saveSeconds);
+    writeScalar(fp, "sms_wal_records_total", "counter", "Records appended to the write-ahead log.", walRecordsWritten);
+    writeScalar(fp, "sms_wal_flushes_total", "counter", "Write-ahead log writes (one per group commit).", walFlushes);
+    writeFamily(fp, "sms_command_seconds", "Command latency.", "command", &metrics.commands, 1);
+    writeFamily(fp, "sms_command_errors_total", "Commands that failed.", "command", &metrics.commandErrors, 0);
+    writeFamily(fp, "sms_search_seconds", "Search latency by kind.", "kind", &metrics.searches, 1);
+    writeFamily(fp, "sms_mutations_total", "Roster changes by operation.", "op", &metrics.mutations, 0);
+    writeFamily(fp, "sms_index_build_seconds", "Index (re)build time.", "index", &metrics.indexBuilds, 1);
+
+    fprintf(fp, "# HELP sms_index_entries Slots or entries held by each index.\n# TYPE sms_index_entries gauge\n");
+    fprintf(fp, "sms_index_entries{index=\"roll\"} %u\n", rollSlots ? rollMask + 1 : 0);
+    fprintf(fp, "sms_index_entries{index=\"sorted_roll\"} %d\n", rollTree ? rollTreeSize : 0);
+    fprintf(fp, "sms_index_entries{index=\"name\"} %u\n", nameSlots ? nameMask + 1 : 0);
+    fprintf(fp, "sms_index_entries{index=\"name_words\"} %d\n", words ? wordCount : 0);
+    fprintf(fp, "sms_index_entries{index=\"duplicate\"} %u\n", dupSlots ? dupMask + 1 : 0);
+    fprintf(fp, "sms_index_entries{index=\"zones\"} %d\n", zones ? zoneCount : 0);
+
+    size_t scratch = arenaBytes(&queryArena);
+    for (int i = 1; i < MAX_WORKERS; ++i) scratch += arenaBytes(&workerArenas[i]);
+    fprintf(fp, "# HELP sms_memory_bytes Memory held per subsystem.\n# TYPE sms_memory_bytes gauge\n");
+    fprintf(fp, "sms_memory_bytes{subsystem=\"records\"} %zu\n", sizeof(Student) * (size_t)studentCapacity);
+    fprintf(fp, "sms_memory_bytes{subsystem=\"roll_index\"} %zu\n", rollSlots ? sizeof(RollSlot) * (rollMask + 1) : 0);
+    fprintf(fp, "sms_memory_bytes{subsystem=\"sorted_roll_index\"} %zu\n", rollTree ? sizeof(RollSlot) * ((size_t)rollTreeSize + 1) : 0);
+    fprintf(fp, "sms_memory_bytes{subsystem=\"name_index\"} %zu\n",
+            (nameSlots ? sizeof(NameSlot) * (nameMask + 1) : 0) + (words ? sizeof(WordRef) * (size_t)wordCount : 0));
+    fprintf(fp, "sms_memory_bytes{subsystem=\"duplicate_index\"} %zu\n", dupSlots ? sizeof(DupSlot) * (dupMask + 1) : 0);
+    fprintf(fp, "sms_memory_bytes{subsystem=\"zone_maps\"} %zu\n", zones ? sizeof(Zone) * (size_t)zoneCap : 0);
+    fprintf(fp, "sms_memory_bytes{subsystem=\"bloom_filters\"} %zu\n",
+            (rollBloom.blocks ? sizeof(BloomBlock) * (rollBloom.mask + 1) : 0) +
+            (nameBloom.blocks ? sizeof(BloomBlock) * (nameBloom.mask + 1) : 0));
+    fprintf(fp, "sms_memory_bytes{subsystem=\"scratch_arenas\"} %zu\n", scratch);
+    fprintf(fp, "# HELP sms_big_alloc_bytes Large allocations by page kind.\n# TYPE sms_big_alloc_bytes gauge\n");
+    fprintf(fp, "sms_big_alloc_bytes{pages=\"hugetlb\"} %ld\n", atomic_load(&bigBytesHugetlb));
+    fprintf(fp, "sms_big_alloc_bytes{pages=\"advised\"} %ld\n", atomic_load(&bigBytesAdvised));
+    fprintf(fp, "sms_big_alloc_bytes{pages=\"normal\"} %ld\n", atomic_load(&bigBytesNormal));
+    long thp = anonHugeBytes();
+    if (thp >= 0) {
+        fprintf(fp, "# HELP sms_anon_huge_page_bytes Anonymous memory backed by transparent huge pages.\n");
+        fprintf(fp, "# TYPE sms_anon_huge_page_bytes gauge\nsms_anon_huge_page_bytes %ld\n", thp);
+    }
+
+    int ok = !ferror(fp);
+    if (fclose(fp) != 0) ok = 0;
+    if (!ok || rename(tmp, metricsPath) != 0) { remove(tmp); return 0; }
+    metricsLastWrite = nowSeconds();
+    return 1;
+}
+
+static void flushMetrics() { writeMetrics(); }
+
+void startMetrics(const char *path) {
+    metricsPath = path;
+    timingOn = 1;
+    atexit(flushMetrics);
+}
+
+/* ---------------- Commands & Workloads ------------- */
+/*
+   Command table shared by the menu, batch mode and workload replay.
+
+   Workload recording (--record FILE) appends one line per command:
+       <microseconds since previous command> <command> <args...>
+   Arguments containing blanks or quotes are written "quoted" with \" and
+   \\ escapes, which is also the syntax accepted by batch files.
+*/
+
+#define MAX_ARGS 64
+
+typedef struct {
+    const char *name;
+    int minArgs;                  // including the command name
+    const char *usage;
+    int (*fn)(int argc, char **argv);
+    int flags;                    // CMD_*
+} Command;
+
+#define CMD_WRITES  1             // changes the roster: waits for a background index build
+#define CMD_PARTIAL 2             // may run before a progressive load finishes
+
+static const Command commands[] = {
+    { "add",     3, "add NAME MARK...",            cmdAdd, CMD_WRITES },
+    { "list",    1, "list [--where EXPR]...",      cmdList, 0 },
+    { "roll",    2, "roll ROLL",                   cmdSearchRoll, CMD_PARTIAL },
+    { "rolls",   3, "rolls LO HI [LIMIT]",         cmdRollRange, 0 },
+    { "name",    2, "name QUERY|=NAME [LIMIT]",    cmdSearchName, CMD_PARTIAL },
+    { "find",    2, "find QUERY [N]",              cmdFind, 0 },
+    { "rename",  3, "rename ROLL NAME",            cmdRename, CMD_WRITES },
+    { "marks",   3, "marks ROLL MARK...",          cmdSetMarks, CMD_WRITES },
+    { "delete",  2, "delete ROLL",                 cmdDelete, CMD_WRITES },
+    { "sort",    2, "sort roll|name|avg [asc|desc]", cmdSort, CMD_WRITES },
+    { "stats",   1, "stats",                       cmdStats, 0 },
+    { "checkpoint", 1, "checkpoint",               cmdCheckpoint, CMD_WRITES },
+    { "begin",   1, "begin",                       cmdBegin, 0 },
+    { "commit",  1, "commit",                      cmdCommit, CMD_WRITES },
+    { "abort",   1, "abort",                       cmdAbort, 0 },
+    { "report",  1, "report",                      cmdReport, 0 },
+    { "arrow",   2, "arrow FILE",                  cmdArrow, 0 },
+    { "term",    2, "term TERM",                   cmdRecordTerm, 0 },
+    { "terms",   1, "terms",                       cmdTermAverages, 0 },
+    { "trend",   2, "trend ROLL",                  cmdRollTrend, 0 },
+    { "history", 2, "history ROLL",                cmdRollMarksHistory, 0 },
+    { "import",  2, "import FILE [--skip-dups] [--marks]", cmdImport, CMD_WRITES },
+    { "dups",    1, "dups [--marks]",              cmdDups, 0 },
+    { "join",    2, "join FILE [--key COL] [--where EXPR]... [--select LIST] [--out FILE]", cmdJoin, 0 },
+};
+#define COMMAND_COUNT ((int)(sizeof(commands) / sizeof(commands[0])))
+
+static FILE *recordFp = NULL;
+static double recordLast = 0.0;
+
+static const Command *findCommand(const char *name) {
+    for (int i = 0; i < COMMAND_COUNT; ++i)
+        if (strcmp(commands[i].name, name) == 0) return &commands[i];
+    return NULL;
+}
+
+static void writeArg(FILE *fp, const char *arg) {
+    if (*arg && !strpbrk(arg, " \t\"\\#")) { fputs(arg, fp); return; }
+    fputc('"', fp);
+    for (const char *p = arg; *p; ++p) {
+        if (*p == '"' || *p == '\\') fputc('\\', fp);
+        fputc(*p, fp);
+    }
+    fputc('"', fp);
+}
+
+static void recordCommand(int argc, char **argv) {
+    double now = nowSeconds();
+    fprintf(recordFp, "%ld", (long)((now - recordLast) * 1e6));
+    recordLast = now;
+    for (int i = 0; i < argc; ++i) {
+        fputc(' ', recordFp);
+        writeArg(recordFp, argv[i]);
+    }
+    fputc('\n', recordFp);
+}
+
+static void stopRecording() {
+    if (recordFp) { fclose(recordFp); recordFp = NULL; }
+}
+
+int startRecording(const char *path) {
+    recordFp = fopen(path, "a");
+    if (!recordFp) { fprintf(stderr, "Error: cannot write %s\n", path); return 0; }
+    fprintf(recordFp, "# sms-workload v1\n");
+    recordLast = nowSeconds();
+    atexit(stopRecording);
+    return 1;
+}
+
+// Splits a command line in place, honouring "quoted args"; returns argc.
+int tokenize(char *line, char **argv, int maxArgs) {
+    int argc = 0;
+    char *p = line;
+    while (argc < maxArgs) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (!*p || *p == '#') break;
+        char *out = p;
+        argv[argc++] = out;
+        if (*p == '"') {
+            p++;
+            while (*p && *p != '"') {
+                if (*p == '\\' && p[1]) p++;
+                *out++ = *p++;
+            }
+            if (*p) p++;
+        } else {
+            while (*p && *p != ' ' && *p != '\t') *out++ = *p++;
+        }
+        if (*p) p++;
+        *out = '\0';
+    }
+    return argc;
+}
+
+int runCommand(int argc, char **argv) {
+    const Command *c = argc > 0 ? findCommand(argv[0]) : NULL;
+    if (!c) { printf("Unknown command '%s'.\n", argc > 0 ? argv[0] : ""); return 1; }
+    if (argc < c->minArgs) { printf("Usage: %s\n", c->usage); return 1; }
+    if (recordFp) recordCommand(argc, argv);
+    if (!(c->flags & CMD_PARTIAL)) waitLoad();
+    if (c->flags & CMD_WRITES) waitIndexBuild();
+    double t0 = spanStart();
+    PROBE2(command__start, c->name, argc);
+    int rc = c->fn(argc, argv);
+    long long ns = nsSince(t0);
+    PROBE3(command__done, c->name, rc, ns);
+    metricObserve(&metrics.commands, c->name, ns);
+    traceSpan(c->name, "command", t0, "rc", rc);
+    if (rc) metricSeries(&metrics.commandErrors, c->name)->count++;
+    resetScratch();
+    if (metricsPath && nowSeconds() - metricsLastWrite >= metricsInterval) writeMetrics();
+    return rc;
+}
+
+// Runs commands from a file ("-" for stdin), one per line.
+int runBatch(const char *path) {
+    FILE *fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!fp) { fprintf(stderr, "Error: cannot open %s\n", path); return 1; }
+    char *line = NULL, *argv[MAX_ARGS];
+    size_t cap = 0;
+    long lineNo = 0;
+    arenaReset(&inputArena);
+    int failures = 0;
+    while (readLine(fp, &inputArena, &line, &cap) >= 0) {
+        lineNo++;
+        int argc = tokenize(line, argv, MAX_ARGS);
+        if (argc == 0) continue;
+        if (runCommand(argc, argv) != 0) {
+            fprintf(stderr, "%s:%ld: '%s' failed\n", path, lineNo, argv[0]);
+            failures++;
+        }
+    }
+    if (fp != stdin) fclose(fp);
+    if (openTxn) {
+        fprintf(stderr, "%s: transaction left open; %d staged change(s) dropped\n", path, txnSize(openTxn));
+        txnAbort(openTxn);
+        openTxn = NULL;
+        failures++;
+    }
+    return failures ? 1 : 0;
+}
+
+typedef struct {
+    double *lat;     // seconds
+    int count, cap;
+} LatencySeries;
+
+static int cmpDoubleAsc(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int n, double p) {
+    int i = (int)(p * (n - 1) + 0.5);
+    return sorted[i];
+}
+
+/*
+   Re-issues a recorded workload. speed > 0 keeps the recorded gaps
+   divided by speed; speed == 0 issues commands back to back. Command
+   output goes to stdout; the latency report goes to stderr.
+*/
+int replayWorkload(const char *path, double speed) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) { fprintf(stderr, "Error: cannot open %s\n", path); return 1; }
+
+    LatencySeries series[COMMAND_COUNT];
+    memset(series, 0, sizeof(series));
+    char *line = NULL, *argv[MAX_ARGS];
+    size_t cap = 0;
+    arenaReset(&inputArena);
+    double start = nowSeconds(), due = 0.0;
+    long issued = 0, failed = 0;
 
+    while (readLine(fp, &inputArena, &line, &cap) >= 0) {
+        char *rest;
+        long gapUs = strtol(line, &rest, 10);
+        if (rest == line) continue;                      // header or comment
+        int argc = tokenize(rest, argv, MAX_ARGS);
+        const Command *c = argc > 0 ? findCommand(argv[0]) : NULL;
+        if (!c) continue;
+
+        if (speed > 0) {
+            due += gapUs / 1e6 / speed;
+            double wait = start + due - nowSeconds();
+#ifndef _WIN32
+            if (wait > 0) {
+                struct timespec ts = { (time_t)wait, (long)((wait - (time_t)wait) * 1e9) };
+                nanosleep(&ts, NULL);
+            }
+#endif
+        }
+
+        double t0 = nowSeconds();
+        if (runCommand(argc, argv) != 0) failed++;
+        double dt = nowSeconds() - t0;
+        issued++;
+
+        LatencySeries *ls = &series[c - commands];
+        if (ls->count == ls->cap) {
+            int ncap = ls->cap ? ls->cap * 2 : 64;
+            double *grown = realloc(ls->lat, sizeof(double) * ncap);
+            if (!grown) continue;
+            ls->lat = grown; ls->cap = ncap;
+        }
+        ls->lat[ls->count++] = dt;
+    }
     fclose(fp);
-    printf("✅ Exported report to '%s'\n", REPORT_FILE);
+    fflush(stdout);
+
+    double total = nowSeconds() - start;
+    long scratchBlocks = atomic_load(&arenaBlockAllocs);
+    fprintf(stderr, "\nReplayed %ld commands (%ld failed) in %.3f s", issued, failed, total);
+    if (speed > 0) fprintf(stderr, " at %.2fx speed\n", speed); else fprintf(stderr, " at max speed\n");
+    fprintf(stderr, "Scratch arena blocks allocated: %ld (flat once warm)\n", scratchBlocks);
+    fprintf(stderr, "%-8s  %8s  %10s  %10s  %10s  %10s  %10s\n",
+            "command", "count", "mean us", "p50 us", "p90 us", "p99 us", "max us");
+    for (int i = 0; i < COMMAND_COUNT; ++i) {
+        LatencySeries *ls = &series[i];
+        if (!ls->count) continue;
+        double sum = 0.0;
+        for (int k = 0; k < ls->count; ++k) sum += ls->lat[k];
+        qsort(ls->lat, ls->count, sizeof(double), cmpDoubleAsc);
+        fprintf(stderr, "%-8s  %8d  %10.1f  %10.1f  %10.1f  %10.1f  %10.1f\n",
+                commands[i].name, ls->count, sum / ls->count * 1e6,
+                percentile(ls->lat, ls->count, 0.50) * 1e6,
+                percentile(ls->lat, ls->count, 0.90) * 1e6,
+                percentile(ls->lat, ls->count, 0.99) * 1e6,
+                ls->lat[ls->count - 1] * 1e6);
+        free(ls->lat);
+    }
+    return failed ? 1 : 0;
+}
+
+/* -------------------- Benchmarks ------------------- */
+/*
+   bench lookups [RECORDS] [LOOKUPS]
+   Builds a synthetic roster in memory (nothing is loaded or saved) once
+   per page mode and times random roll lookups through the hash index
+   and through the sorted (Eytzinger) index.
+   dTLB read misses come from perf_event_open where the kernel allows it.
+*/
+
+typedef struct { int fd; } TlbCounter;
+
+TlbCounter tlbCounterStart() {
+    TlbCounter c = { -1 };
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    c.fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (c.fd >= 0) {
+        ioctl(c.fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(c.fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+    return c;
+}
+
+// Returns the miss count, or -1 when the counter is unavailable.
+long long tlbCounterStop(TlbCounter c) {
+    long long misses = -1;
+#ifdef __linux__
+    if (c.fd >= 0) {
+        ioctl(c.fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(c.fd, &misses, sizeof(misses)) != sizeof(misses)) misses = -1;
+        close(c.fd);
+    }
+#else
+    (void)c;
+#endif
+    return misses;
+}
+
+static unsigned benchRand(unsigned *state) {
+    *state ^= *state << 13; *state ^= *state >> 17; *state ^= *state << 5;
+    return *state;
+}
+
+int benchLookups(int records, long lookups) {
+    static const int modes[] = { HP_OFF, HP_AUTO };
+    static const char *modeNames[] = { "4k pages", "huge pages" };
+    printf("%-11s  %-7s  %10s  %10s  %12s  %14s\n", "pages", "index", "records", "lookups", "ns/lookup", "dTLB misses");
+    for (int m = 0; m < 2; ++m) {
+        hugePageMode = modes[m];
+        bigFree(students); students = NULL; studentCapacity = 0; studentCount = 0;
+        bigFree(rollSlots); rollSlots = NULL; rollMask = 0;
+        if (!reserveStudents(records)) { printf("Error: cannot allocate %d records\n", records); return 1; }
+        for (int i = 0; i < records; ++i) {
+            Student *s = &students[i];
+            memset(s, 0, sizeof(*s));
+            s->roll = i + 1;
+            s->subjectCount = 1;
+            s->marks[0] = i % 101;
+        }
+        studentCount = records;
+        bloomsInvalidate();
+        rosterChanged();
+        bigFree(rollTree); rollTree = NULL; rollTreeSize = 0;
+
+        for (int sorted = 0; sorted < 2; ++sorted) {
+            sortedRollLookups = sorted;
+            findIndexByRoll(1);                             // build the index outside the timing
+
+            unsigned seed = 2463534242u;
+            long checksum = 0;
+            TlbCounter tlb = tlbCounterStart();
+            double t0 = nowSeconds();
+            for (long k = 0; k < lookups; ++k) {
+                int idx = findIndexByRoll((int)(benchRand(&seed) % (unsigned)records) + 1);
+                checksum += students[idx].marks[0];         // touch the record, as real lookups do
+            }
+            double dt = nowSeconds() - t0;
+            long long misses = tlbCounterStop(tlb);
+
+            char missText[32];
+            if (misses >= 0) snprintf(missText, sizeof(missText), "%lld", misses);
+            else snprintf(missText, sizeof(missText), "n/a");
+            long thp = anonHugeBytes();
+            char thpText[32];
+            if (thp >= 0) snprintf(thpText, sizeof(thpText), "%ld MB", thp >> 20);
+            else snprintf(thpText, sizeof(thpText), "n/a");
+            printf("%-11s  %-7s  %10d  %10ld  %12.1f  %14s   (%ld MB hugetlb, %ld MB advised, THP-backed %s, checksum %ld)\n",
+                   modeNames[m], sorted ? "sorted" : "hash", records, lookups, dt / lookups * 1e9, missText,
+                   atomic_load(&bigBytesHugetlb) >> 20, atomic_load(&bigBytesAdvised) >> 20, thpText, checksum);
+        }
+    }
+    return 0;
+}
+
+/*
+   bench map [RECORDS] [OPS] [WRITE%]
+   Mixed random lookups, inserts and removes against the concurrent roll
+   map, with 1, 2, 4 ... workerCount() threads (--threads N to choose),
+   prefilled with RECORDS rolls out of a key space twice that size.
+   Writes are half puts, half removes, so the map stays about that full.
+   Each run is repeated with one global mutex around every call, which is
+   what the map's stripes and lock-free lookups are measured against.
+*/
+
+#ifndef _WIN32
+typedef struct {
+    RollMap *map;
+    pthread_mutex_t *global;            // NULL: call the map directly
+    int records, writePct;
+    atomic_long hits;
+} MapBench;
+
+static void benchMapRange(void *ctx, int begin, int end) {
+    MapBench *b = ctx;
+    unsigned seed = ((unsigned)begin * 2654435761u) | 1;
+    long hits = 0;
+    for (int k = begin; k < end; ++k) {
+        int roll = (int)(benchRand(&seed) % (unsigned)(2 * b->records)) + 1;
+        int write = (int)(benchRand(&seed) % 100) < b->writePct;
+        if (b->global) pthread_mutex_lock(b->global);
+        if (!write) hits += rollMapGet(b->map, roll) >= 0;
+        else if (benchRand(&seed) & 1) rollMapPut(b->map, roll, roll - 1);
+        else rollMapRemove(b->map, roll);
+        if (b->global) pthread_mutex_unlock(b->global);
+    }
+    atomic_fetch_add(&b->hits, hits);
+}
+
+// Mops/s for one run on a freshly filled map, or -1 if out of memory.
+static double runMapBench(int records, int ops, int writePct, pthread_mutex_t *global, int *entries) {
+    MapBench b = { rollMapCreate(records), global, records, writePct, 0 };
+    if (!b.map) return -1;
+    for (int roll = 1; roll <= records; ++roll)
+        if (!rollMapPut(b.map, roll, roll - 1)) { rollMapFree(b.map); return -1; }
+    double t0 = nowSeconds();
+    parallelFor(ops, 1, benchMapRange, &b);
+    double dt = nowSeconds() - t0;
+    *entries = rollMapCount(b.map);
+    rollMapFree(b.map);
+    return ops / dt / 1e6;
+}
+#endif
+
+int benchMap(int records, int ops, int writePct) {
+#ifdef _WIN32
+    (void)records; (void)ops; (void)writePct;
+    printf("Error: bench map needs threads\n");
+    return 1;
+#else
+    int maxThreads = workerCount(), saved = workerThreads;
+    double first = 0;
+    pthread_mutex_t global = PTHREAD_MUTEX_INITIALIZER;
+    printf("%7s  %10s  %10s  %6s  %10s  %8s  %14s  %10s\n", "threads", "records", "ops", "writes",
+           "Mops/s", "speedup", "global Mops/s", "entries");
+    for (int threads = 1;; threads = threads * 2 < maxThreads ? threads * 2 : maxThreads) {
+        int entries = 0, lockedEntries = 0;
+        workerThreads = threads;
+        double rate = runMapBench(records, ops, writePct, NULL, &entries);
+        double locked = runMapBench(records, ops, writePct, &global, &lockedEntries);
+        if (rate < 0 || locked < 0) { workerThreads = saved; printf("Error: cannot allocate %d records\n", records); return 1; }
+        if (threads == 1) first = rate;
+        printf("%7d  %10d  %10d  %5d%%  %10.2f  %7.2fx  %14.2f  %10d\n", threads, records, ops, writePct,
+               rate, rate / first, locked, entries);
+        if (threads == maxThreads) break;
+    }
+    workerThreads = saved;
+    return 0;
+#endif
+}
+
+#ifndef _WIN32
+// Fills the roster with rolls 1..records, every mark 50. 0 if out of memory.
+static int benchRoster(int records) {
+    if (!reserveStudents(records)) return 0;
+    for (int i = 0; i < records; ++i) {
+        Student *s = &students[i];
+        memset(s, 0, sizeof(*s));
+        s->roll = i + 1;
+        s->subjectCount = MAX_SUBJECTS;
+        for (int m = 0; m < MAX_SUBJECTS; ++m) s->marks[m] = 50;
+        recompute(s);
+    }
+    studentCount = records;
+    return 1;
+}
+#endif
+
+/*
+   bench edits [RECORDS] [OPS] [WRITE%]
+   Readers take versioned snapshots of random records while writers set
+   every mark of a random record to one new value through editStudent(),
+   with 1, 2, 4 ... workerCount() threads, then again under one global
+   mutex. Each snapshot is checked (its marks all equal, its average
+   matching), so a torn read would show up in the "torn" column. A small
+   RECORDS makes writers collide and retry.
+*/
+
+#ifndef _WIN32
+typedef struct {
+    pthread_mutex_t *global;            // NULL: rely on the record versions
+    int writePct;
+    atomic_long torn, retries;
+} EditBench;
+
+typedef struct { int mark, calls; } MarkEdit;
+
+static int setAllMarks(Student *s, void *ctx) {
+    MarkEdit *e = ctx;
+    e->calls++;
+    for (int i = 0; i < s->subjectCount; ++i) s->marks[i] = e->mark;
+    recompute(s);
+    return 1;
+}
+
+static void benchEditRange(void *ctx, int begin, int end) {
+    EditBench *b = ctx;
+    unsigned seed = ((unsigned)begin * 2654435761u) | 1;
+    long torn = 0, retries = 0;
+    for (int k = begin; k < end; ++k) {
+        int idx = (int)(benchRand(&seed) % (unsigned)studentCount);
+        int write = (int)(benchRand(&seed) % 100) < b->writePct;
+        if (b->global) pthread_mutex_lock(b->global);
+        if (write) {
+            MarkEdit e = { (int)(benchRand(&seed) % 101), 0 };
+            while (editStudent(idx, setAllMarks, &e, EDIT_ATTEMPTS) < 0) {}
+            retries += e.calls - 1;
+        } else {
+            Student s;
+            readStudent(idx, &s);
+            int bad = s.average != (float)s.marks[0];
+            for (int i = 1; i < s.subjectCount; ++i) bad |= s.marks[i] != s.marks[0];
+            torn += bad;
+        }
+        if (b->global) pthread_mutex_unlock(b->global);
+    }
+    atomic_fetch_add(&b->torn, torn);
+    atomic_fetch_add(&b->retries, retries);
+}
+#endif
+
+int benchEdits(int records, int ops, int writePct) {
+#ifdef _WIN32
+    (void)records; (void)ops; (void)writePct;
+    printf("Error: bench edits needs threads\n");
+    return 1;
+#else
+    if (!benchRoster(records)) { printf("Error: cannot allocate %d records\n", records); return 1; }
+
+    int maxThreads = workerCount(), saved = workerThreads;
+    double first = 0;
+    pthread_mutex_t global = PTHREAD_MUTEX_INITIALIZER;
+    printf("%7s  %10s  %10s  %6s  %10s  %8s  %14s  %10s  %6s\n", "threads", "records", "ops", "writes",
+           "Mops/s", "speedup", "global Mops/s", "retries", "torn");
+    for (int threads = 1;; threads = threads * 2 < maxThreads ? threads * 2 : maxThreads) {
+        EditBench b = { NULL, writePct, 0, 0 }, locked = { &global, writePct, 0, 0 };
+        workerThreads = threads;
+        double t0 = nowSeconds();
+        parallelFor(ops, 1, benchEditRange, &b);
+        double rate = ops / (nowSeconds() - t0) / 1e6;
+        t0 = nowSeconds();
+        parallelFor(ops, 1, benchEditRange, &locked);
+        double lockedRate = ops / (nowSeconds() - t0) / 1e6;
+        if (threads == 1) first = rate;
+        printf("%7d  %10d  %10d  %5d%%  %10.2f  %7.2fx  %14.2f  %10ld  %6ld\n", threads, records, ops, writePct,
+               rate, rate / first, lockedRate, atomic_load(&b.retries), atomic_load(&b.torn) + atomic_load(&locked.torn));
+        if (threads == maxThreads) break;
+    }
+    workerThreads = saved;
+    return 0;
+#endif
+}
+
+/*
+   bench commits [RECORDS] [TXNS] [SIZE]
+   Committers run TXNS transactions, each setting the marks of SIZE
+   random records, with 1, 2, 4 ... workerCount() threads, against a
+   scratch log synced after every write as with --wal-sync. Committers
+   waiting on the same write share it, so "flushes" falls below TXNS
+   and "recs/flush" (marker included) climbs as threads are added.
+*/
+
+#ifndef _WIN32
+typedef struct {
+    int records, size;
+    atomic_long failed;
+} CommitBench;
+
+static void benchCommitRange(void *ctx, int begin, int end) {
+    CommitBench *b = ctx;
+    unsigned seed = ((unsigned)begin * 2654435761u) | 1;
+    long failed = 0;
+    for (int k = begin; k < end; ++k) {
+        Txn *t = txnBegin();
+        int staged = t != NULL;
+        for (int j = 0; staged && j < b->size; ++j) {
+            Student s = { .roll = (int)(benchRand(&seed) % (unsigned)b->records) + 1, .subjectCount = MAX_SUBJECTS };
+            for (int m = 0; m < MAX_SUBJECTS; ++m) s.marks[m] = (int)(benchRand(&seed) % 101);
+            staged = txnStage(t, WAL_MARKS, &s);
+        }
+        char err[160];
+        if (!staged) { txnAbort(t); failed++; }
+        else if (txnCommit(t, err, sizeof(err)) != b->size) failed++;
+    }
+    atomic_fetch_add(&b->failed, failed);
+}
+#endif
+
+int benchCommits(int records, int txns, int size) {
+#ifdef _WIN32
+    (void)records; (void)txns; (void)size;
+    printf("Error: bench commits needs threads\n");
+    return 1;
+#else
+    if (!benchRoster(records)) { printf("Error: cannot allocate %d records\n", records); return 1; }
+    if (!(walFp = tmpfile())) { printf("Error: cannot create a scratch log\n"); return 1; }
+    walSync = 1;
+    checkpointEvery = 1 << 30;                              // never snapshot mid-run
+
+    int maxThreads = workerCount(), saved = workerThreads;
+    double first = 0;
+    printf("%7s  %10s  %8s  %6s  %10s  %8s  %10s  %10s  %6s\n", "threads", "records", "txns", "size",
+           "commits/s", "speedup", "flushes", "recs/flush", "failed");
+    for (int threads = 1;; threads = threads * 2 < maxThreads ? threads * 2 : maxThreads) {
+        CommitBench b = { records, size, 0 };
+        long flushes = walFlushes, written = walRecordsWritten;
+        workerThreads = threads;
+        double t0 = nowSeconds();
+        parallelFor(txns, 1, benchCommitRange, &b);
+        double rate = txns / (nowSeconds() - t0);
+        flushes = walFlushes - flushes;
+        written = walRecordsWritten - written;
+        if (threads == 1) first = rate;
+        printf("%7d  %10d  %8d  %6d  %10.0f  %7.2fx  %10ld  %10.2f  %6ld\n", threads, records, txns, size,
+               rate, rate / first, flushes, flushes ? (double)written / flushes : 0.0, atomic_load(&b.failed));
+        if (threads == maxThreads) break;
+    }
+    workerThreads = saved;
+    fclose(walFp);
+    walFp = NULL;
+    return 0;
+#endif
 }
 
 /* ---------------------- Menu ----------------------- */
@@ -512,9 +7193,17 @@ void menu() {
         printf("7) Sort Records\n");
         printf("8) Statistics\n");
         printf("9) Export Report\n");
+        printf("10) Term History\n");
+        printf("11) Join External CSV\n");
+        printf("12) Smart Search\n");
+        printf("13) Roll Range\n");
+        printf("14) Import & Duplicates\n");
         printf("0) Exit\n");
 
-        int choice = inputIntInRange("\nChoose an option: ", 0, 9);
+        int choice = inputIntInRange("\nChoose an option: ", 0, 14);
+        waitLoad();                                         // menu actions read the roster directly
+        if (choice <= 1 || (choice >= 5 && choice <= 7) || choice == 14)
+            waitIndexBuild();                               // they change it: as runCommand() does for CMD_WRITES
         clearScreen();
         switch (choice) {
             case 1: printBanner(); addStudent();        waitEnter(); break;
@@ -526,12 +7215,105 @@ void menu() {
             case 7: printBanner(); sortMenu();          waitEnter(); break;
             case 8: printBanner(); showStats();         waitEnter(); break;
             case 9: printBanner(); exportReport();      waitEnter(); break;
+            case 10: printBanner(); historyMenu();      waitEnter(); break;
+            case 11: printBanner(); joinMenu();         waitEnter(); break;
+            case 12: printBanner(); smartSearchMenu();  waitEnter(); break;
+            case 13: printBanner(); rollRangeMenu();    waitEnter(); break;
+            case 14: printBanner(); importMenu();       waitEnter(); break;
             case 0: printf("Saving & exiting... Bye!\n"); saveAll(); return;
         }
     }
 }
 
-int main(void) {
+void printUsage(const char *prog) {
+    printf("Usage: %s [--data FILE] [--record FILE] [--lazy-names] [--threads N]\n", prog);
+    printf("          [--wal | --wal-sync] [--checkpoint-every N]\n");
+    printf("          [--hugepages auto|madvise|hugetlb|off] [--roll-index hash|sorted]\n");
+    printf("          [--metrics FILE.prom] [--metrics-interval SECONDS] [--trace FILE.json] [command]\n\n");
+    printf("  (no command)              interactive menu\n");
+    printf("  batch FILE|-              run commands from a file, one per line\n");
+    printf("  replay FILE [--speed X]   re-issue a recorded workload (X = factor or 'max')\n");
+    printf("                            and report latency percentiles per command\n");
+    printf("  bench lookups [N] [L]     time L random roll lookups over N synthetic records,\n");
+    printf("                            with 4k vs huge pages, hash vs sorted index\n");
+    printf("  bench map [N] [OPS] [W]   mixed lookups and writes (W%% of OPS) on the concurrent\n");
+    printf("                            roll map over N rolls, per thread count\n");
+    printf("  bench edits [N] [OPS] [W] versioned snapshot reads and optimistic edits (W%% of\n");
+    printf("                            OPS) over N records, per thread count\n");
+    printf("  bench commits [N] [T] [S] T transactions of S mark changes over N records,\n");
+    printf("                            synced like --wal-sync; flushes shared per thread count\n");
+    printf("\nCommands (usable directly, in batch files and in recordings):\n");
+    for (int i = 0; i < COMMAND_COUNT; ++i) printf("  %s\n", commands[i].usage);
+}
+
+int main(int argc, char **argv) {
+    processStart = (double)time(NULL);
+    int i = 1;
+    for (; i < argc && strncmp(argv[i], "--", 2) == 0; ++i) {
+        if (strcmp(argv[i], "--lazy-names") == 0) { lazyNames = 1; continue; }
+        if (strcmp(argv[i], "--wal") == 0) { walEnabled = 1; continue; }
+        if (strcmp(argv[i], "--wal-sync") == 0) { walEnabled = walSync = 1; continue; }
+        if (i + 1 >= argc) { printUsage(argv[0]); return 2; }
+        if (strcmp(argv[i], "--data") == 0) dataFile = argv[++i];
+        else if (strcmp(argv[i], "--threads") == 0) workerThreads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--roll-index") == 0) {
+            const char *kind = argv[++i];
+            if (strcmp(kind, "sorted") == 0) sortedRollLookups = 1;
+            else if (strcmp(kind, "hash") == 0) sortedRollLookups = 0;
+            else { printUsage(argv[0]); return 2; }
+        }
+        else if (strcmp(argv[i], "--checkpoint-every") == 0) checkpointEvery = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--metrics") == 0) startMetrics(argv[++i]);
+        else if (strcmp(argv[i], "--trace") == 0) startTrace(argv[++i]);
+        else if (strcmp(argv[i], "--metrics-interval") == 0) metricsInterval = atof(argv[++i]);
+        else if (strcmp(argv[i], "--hugepages") == 0) {
+            if ((hugePageMode = parseHugePageMode(argv[++i])) < 0) { printUsage(argv[0]); return 2; }
+        }
+        else if (strcmp(argv[i], "--record") == 0) { if (!startRecording(argv[++i])) return 1; }
+        else { printUsage(argv[0]); return 2; }
+    }
+
+    if (i < argc) {
+        setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+        if (strcmp(argv[i], "bench") == 0 && i + 1 < argc && strcmp(argv[i + 1], "lookups") == 0) {
+            int records = i + 2 < argc ? atoi(argv[i + 2]) : 4000000;
+            long lookups = i + 3 < argc ? atol(argv[i + 3]) : 10000000;
+            if (records < 1 || records > MAX_STUDENTS || lookups < 1) { printUsage(argv[0]); return 2; }
+            return benchLookups(records, lookups);
+        }
+        if (strcmp(argv[i], "bench") == 0 && i + 1 < argc && strcmp(argv[i + 1], "map") == 0) {
+            int records = i + 2 < argc ? atoi(argv[i + 2]) : 1000000;
+            int ops = i + 3 < argc ? atoi(argv[i + 3]) : 10000000;
+            int writePct = i + 4 < argc ? atoi(argv[i + 4]) : 10;
+            if (records < 1 || records > MAX_STUDENTS || ops < 1 || writePct < 0 || writePct > 100) { printUsage(argv[0]); return 2; }
+            return benchMap(records, ops, writePct);
+        }
+        if (strcmp(argv[i], "bench") == 0 && i + 1 < argc && strcmp(argv[i + 1], "edits") == 0) {
+            int records = i + 2 < argc ? atoi(argv[i + 2]) : 100000;
+            int ops = i + 3 < argc ? atoi(argv[i + 3]) : 10000000;
+            int writePct = i + 4 < argc ? atoi(argv[i + 4]) : 20;
+            if (records < 1 || records > MAX_STUDENTS || ops < 1 || writePct < 0 || writePct > 100) { printUsage(argv[0]); return 2; }
+            return benchEdits(records, ops, writePct);
+        }
+        if (strcmp(argv[i], "bench") == 0 && i + 1 < argc && strcmp(argv[i + 1], "commits") == 0) {
+            int records = i + 2 < argc ? atoi(argv[i + 2]) : 1000;
+            int txns = i + 3 < argc ? atoi(argv[i + 3]) : 2000;
+            int size = i + 4 < argc ? atoi(argv[i + 4]) : 5;
+            if (records < 1 || records > MAX_STUDENTS || txns < 1 || size < 1 || size > 10000) { printUsage(argv[0]); return 2; }
+            return benchCommits(records, txns, size);
+        }
+        loadAll();
+        if (strcmp(argv[i], "batch") == 0 && i + 1 < argc) return runBatch(argv[i + 1]);
+        if (strcmp(argv[i], "replay") == 0 && i + 1 < argc) {
+            double speed = 1.0;
+            if (i + 3 < argc && strcmp(argv[i + 2], "--speed") == 0)
+                speed = strcmp(argv[i + 3], "max") == 0 ? 0.0 : atof(argv[i + 3]);
+            return replayWorkload(argv[i + 1], speed);
+        }
+        if (findCommand(argv[i])) return runCommand(argc - i, argv + i);
+        printUsage(argv[0]);
+        return 2;
+    }
     loadAll();
     menu();
     return 0;
@@ -0,0 +1,20 @@
+# arrow FILE must read back in pyarrow with the roster's own values.
+python3 -c 'import pyarrow' 2>/dev/null || exit 77
+"$SMS" --data students.csv add "Chloé Dupont" 90 80 70
+"$SMS" --data students.csv add "Иван Петров" 60
+"$SMS" --data students.csv add "Alan Turing" 35 45
+"$SMS" --data students.csv delete 2
+"$SMS" --data students.csv arrow roster.arrow
+python3 - <<'PY'
+import csv, pyarrow.ipc as ipc
+table = ipc.open_file("roster.arrow").read_all()
+print(table.schema)
+for row in table.to_pylist():
+    print(row)
+with open("students.csv", newline="", encoding="utf-8") as f:
+    csvRows = list(csv.DictReader(f))
+assert [r["roll"] for r in table.to_pylist()] == [int(r["roll"]) for r in csvRows]
+assert [r["name"] for r in table.to_pylist()] == [r["name"] for r in csvRows]
+assert [r["marks"] for r in table.to_pylist()] == [[int(m) for m in r["marks"].split(";")] for r in csvRows]
+print("round trip ok")
+PY
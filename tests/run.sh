@@ -0,0 +1,47 @@
+#!/bin/sh
+# Builds the program and runs each test in a fresh directory, comparing
+# its output (stdout and stderr) with NAME.expected, durations masked:
+#   NAME.batch  run as "batch NAME.batch" against an empty students.csv
+#   NAME.sh     run with $SMS set to the program, for tests that need more
+#               than one invocation or must damage files between them;
+#               exit status 77 skips the test (a tool it needs is missing)
+# Usage: sh tests/run.sh [NAME...]
+
+cd "$(dirname "$0")" || exit 2
+TESTS=$(pwd)
+WORK=$(mktemp -d) || exit 2
+trap 'rm -rf "$WORK"' EXIT
+SMS="$WORK/sms"
+export SMS
+${CC:-cc} -O2 -pthread -o "$SMS" "../student_management_system_(final).c" || exit 2
+
+if [ $# -eq 0 ]; then
+    set -- $(ls *.batch *.sh 2>/dev/null | grep -v '^run\.sh$' | sed 's/\.[a-z]*$//' | sort -u)
+fi
+
+pass=0 fail=0 skip=0
+for name in "$@"; do
+    dir="$WORK/$name"
+    mkdir "$dir"
+    if [ -f "$name.batch" ]; then
+        (cd "$dir" && cp "$TESTS/$name.batch" . && "$SMS" --data students.csv batch "$name.batch") > "$dir/raw" 2>&1
+    else
+        (cd "$dir" && sh "$TESTS/$name.sh") > "$dir/raw" 2>&1
+        if [ $? -eq 77 ]; then
+            skip=$((skip + 1))
+            echo "skip  $name"
+            continue
+        fi
+    fi
+    sed -E 's/[0-9][0-9.]* (ns|us|ms|s)([^a-z]|$)/# \1\2/g' "$dir/raw" > "$dir/out"
+    if diff -u "$name.expected" "$dir/out" > "$dir/diff"; then
+        pass=$((pass + 1))
+        echo "ok    $name"
+    else
+        fail=$((fail + 1))
+        echo "FAIL  $name"
+        cat "$dir/diff"
+    fi
+done
+echo "$pass passed, $fail failed, $skip skipped"
+[ "$fail" -eq 0 ]
@@ -0,0 +1,11 @@
+# A transaction is logged as one batch: recovery replays all of it, or
+# none of it when the batch was torn by a crash.
+"$SMS" --wal --data students.csv add "Ada Lovelace" 90 80
+printf 'begin\nmarks 1 50 40\nadd "Alan Turing" 70 60\nadd "Grace Hopper" 95 85\ncommit\n' > txn.batch
+"$SMS" --wal --data students.csv batch txn.batch
+size=$(wc -c < students.csv.wal)
+cp students.csv.wal complete.wal
+head -c $((size - 5)) complete.wal > students.csv.wal
+"$SMS" --wal --data students.csv list
+cp complete.wal students.csv.wal
+"$SMS" --wal --data students.csv list
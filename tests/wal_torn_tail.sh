@@ -0,0 +1,12 @@
+# A crash mid-append leaves a torn record at the end of the log. Recovery
+# must replay every complete record, cut off the torn one, and leave a
+# log that takes new appends; a checkpoint then folds it into the snapshot.
+"$SMS" --wal --data students.csv add "Ada Lovelace" 90 80
+"$SMS" --wal --data students.csv add "Alan Turing" 70 60
+"$SMS" --wal --data students.csv rename 1 "Ada King"
+size=$(wc -c < students.csv.wal)
+head -c $((size - 3)) students.csv.wal > torn.wal && mv torn.wal students.csv.wal
+"$SMS" --wal --data students.csv list
+"$SMS" --wal --data students.csv add "Grace Hopper" 95 85
+"$SMS" --wal --data students.csv checkpoint
+"$SMS" --data students.csv list